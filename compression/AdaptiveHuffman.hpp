@@ -0,0 +1,273 @@
+#ifndef CODINGADAPTIVEHUFFMAN_HPP
+#define CODINGADAPTIVEHUFFMAN_HPP
+
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <stdexcept>
+
+#include <Base.hpp>
+#include <Arena.hpp>
+#include <Huffman.hpp>
+#include <Trace.hpp>
+
+namespace coding {
+
+// one-pass huffman (FGK): encoder and decoder start from the same empty
+// tree and update it after every symbol, so no distribution is needed up
+// front and streams of any length can be coded as they arrive. symbols are
+// introduced by the code of the not-yet-transmitted (NYT) leaf followed by
+// their alphabet index.
+//
+// nodes live in an array ordered by weight (the sibling property), the
+// root last; an update swaps a node with the highest-numbered node of the
+// same weight before incrementing it, which keeps the order. the swaps
+// go by position and weight, which HuffmanNode does not have, so the tree
+// is its own array, kept like Huffman's in an arena rewound per message.
+//
+// for a stream, use one instance per side and call encode_more/decode_more
+// on each chunk.
+struct AdaptiveHuffman {
+  // bits resolved by one lookup in the decoding table
+  static constexpr int TABLE_BITS = 8;
+  // the table is rebuilt once the tree has kept its shape this long
+  static constexpr uint64_t REBUILD_AFTER = 256;
+
+  // keeps a shared model alive, meta refers to it
+  std::shared_ptr<const CodingMeta> shared_meta;
+  const CodingMeta &meta;
+
+  struct Node {
+    uint64_t weight;
+    int parent;
+    int child[2];
+    // alphabet index on leaves, -1 on internal nodes and NYT
+    int symbol;
+  };
+
+  struct Entry {
+    int node;
+    int bits;
+  };
+
+  // tree, leaves and decoding table of the message
+  Arena scratch;
+  Node *nodes = nullptr;
+  int *leaf_of = nullptr;
+  Entry *table = nullptr;
+  std::array<int16_t, 256> index_of;
+  int root = 0;
+  int nyt = 0;
+  // bumped on every change of shape
+  uint64_t version = 0;
+  uint64_t stable = 0;
+  uint64_t table_version = ~uint64_t(0);
+  uint64_t table_rebuilds = 0;
+  double avglen = 0.;
+  // optional instrumentation
+  Trace *trace = nullptr;
+
+  AdaptiveHuffman(const CodingMeta &meta):
+    meta(meta)
+  {
+    index_of.fill(-1);
+    for(size_t i = 0; i < meta.size(); ++i) {
+      index_of[uint8_t(meta.get_char(i))] = i;
+    }
+    reset();
+  }
+
+  AdaptiveHuffman(std::shared_ptr<const CodingMeta> meta):
+    AdaptiveHuffman(*meta)
+  {
+    shared_meta = std::move(meta);
+  }
+
+  int bits_sym() const noexcept {
+    return std::max(1, Huffman::ceil_log2(meta.size()));
+  }
+
+  void reset() {
+    const size_t n = meta.size();
+    scratch.reset();
+    nodes = scratch.make_array<Node>(2 * n + 1);
+    std::fill(nodes, nodes + 2 * n + 1, Node{0, -1, {-1, -1}, -1});
+    root = nyt = 2 * n;
+    leaf_of = scratch.make_array<int>(n);
+    std::fill(leaf_of, leaf_of + n, -1);
+    table = scratch.make_array<Entry>(size_t(1) << TABLE_BITS);
+    ++version;
+    stable = 0;
+  }
+
+  bool is_leaf(int k) const noexcept {
+    return nodes[k].child[0] == -1;
+  }
+
+  // exchange the subtrees at two positions, parents stay with the position
+  void swap_nodes(int a, int b) {
+    std::swap(nodes[a].weight, nodes[b].weight);
+    std::swap(nodes[a].symbol, nodes[b].symbol);
+    std::swap(nodes[a].child, nodes[b].child);
+    for(int k : {a, b}) {
+      if(is_leaf(k)) {
+        leaf_of[nodes[k].symbol] = k;
+      } else {
+        nodes[nodes[k].child[0]].parent = nodes[nodes[k].child[1]].parent = k;
+      }
+    }
+    ++version;
+  }
+
+  void update(int symbol) {
+    int q = leaf_of[symbol];
+    if(q == -1) {
+      // NYT becomes an internal node over the new NYT and the new leaf
+      const int z = nyt;
+      nyt = z - 2, q = z - 1;
+      nodes[z].child[0] = nyt, nodes[z].child[1] = q;
+      nodes[nyt] = Node{0, z, {-1, -1}, -1};
+      nodes[q] = Node{0, z, {-1, -1}, symbol};
+      leaf_of[symbol] = q;
+      ++version;
+    }
+    while(q != root) {
+      int leader = q;
+      while(leader + 1 < root && nodes[leader + 1].weight == nodes[q].weight) {
+        ++leader;
+      }
+      if(leader != q && leader != nodes[q].parent) {
+        swap_nodes(q, leader);
+        q = leader;
+      }
+      ++nodes[q].weight;
+      q = nodes[q].parent;
+    }
+    ++nodes[root].weight;
+  }
+
+  void append_path(DynamicBitset &bset, int k) const {
+    // at most one level per leaf
+    bool bits[257];
+    int depth = 0;
+    for(; k != root; k = nodes[k].parent) {
+      bits[depth++] = nodes[nodes[k].parent].child[1] == k;
+    }
+    while(depth > 0) {
+      bset.append_bit(bits[--depth]);
+    }
+  }
+
+  void encode_more(const std::string &text, DynamicBitset &bset) {
+    const int nbits = bits_sym();
+    for(auto c : text) {
+      const int x = index_of[uint8_t(c)];
+      if(x < 0) {
+        throw std::domain_error("symbol outside of the alphabet");
+      }
+      if(leaf_of[x] != -1) {
+        append_path(bset, leaf_of[x]);
+      } else {
+        append_path(bset, nyt);
+        for(int i = nbits - 1; i >= 0; --i) {
+          bset.append_bit((x >> i) & 1);
+        }
+      }
+      update(x);
+    }
+  }
+
+  DynamicBitset encode(const std::string &text) {
+    Trace::Timer timer(trace, "adaptive_huffman.encode");
+    DynamicBitset bset;
+    reset();
+    const auto before = version;
+    encode_more(text, bset);
+    if(trace) {
+      trace->count("adaptive_huffman.shape_changes", version - before);
+    }
+    avglen = text.empty() ? 0. : double(bset.size()) / text.length();
+    return bset;
+  }
+
+  // bits per symbol of the last message
+  double average_length() {
+    return avglen;
+  }
+
+  // node reached from the root by every TABLE_BITS-bit prefix
+  void rebuild_table() {
+    for(size_t v = 0; v < (size_t(1) << TABLE_BITS); ++v) {
+      int k = root, bits = 0;
+      while(bits < TABLE_BITS && !is_leaf(k)) {
+        k = nodes[k].child[(v >> (TABLE_BITS - 1 - bits)) & 1];
+        ++bits;
+      }
+      table[v] = Entry{k, bits};
+    }
+    table_version = version;
+    ++table_rebuilds;
+  }
+
+  // decodes the complete symbols from pos on; pos is left at the first
+  // symbol whose bits have not all arrived yet
+  void decode_more(const DynamicBitset &bset, size_t &pos, std::string &s) {
+    const int nbits = bits_sym();
+    while(pos < bset.size()) {
+      if(version != table_version && ++stable >= REBUILD_AFTER) {
+        rebuild_table();
+      }
+      size_t i = pos;
+      int k = root;
+      if(version == table_version && i + TABLE_BITS <= bset.size()) {
+        const auto &e = table[bset.get_bits(i, TABLE_BITS)];
+        k = e.node, i += e.bits;
+      }
+      while(!is_leaf(k) && i < bset.size()) {
+        k = nodes[k].child[bset[i++]];
+      }
+      if(!is_leaf(k)) {
+        return;
+      }
+      int x = nodes[k].symbol;
+      if(k == nyt) {
+        if(i + nbits > bset.size()) {
+          return;
+        }
+        x = bset.get_bits(i, nbits);
+        i += nbits;
+        if(x >= int(meta.size())) {
+          throw std::domain_error("symbol outside of the alphabet");
+        }
+      }
+      const auto before = version;
+      update(x);
+      if(version != before) {
+        stable = 0;
+      }
+      s += meta.get_char(x);
+      pos = i;
+    }
+  }
+
+  std::string decode(const DynamicBitset &bset) {
+    Trace::Timer timer(trace, "adaptive_huffman.decode");
+    std::string s;
+    size_t pos = 0;
+    reset();
+    const auto before = table_rebuilds;
+    decode_more(bset, pos, s);
+    if(trace) {
+      trace->count("adaptive_huffman.table_rebuilds", table_rebuilds - before);
+    }
+    if(pos != bset.size()) {
+      throw std::domain_error("unable to fully decode the text");
+    }
+    return s;
+  }
+};
+
+} // namespace coding
+
+#endif /* end of include guard: CODINGADAPTIVEHUFFMAN_HPP */
@@ -0,0 +1,145 @@
+#ifndef CODINGARENA_HPP
+#define CODINGARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+#include <type_traits>
+
+namespace coding {
+
+// bump allocator for per-message scratch memory. nothing is freed
+// individually: reset() rewinds the arena between messages and keeps the
+// memory, so once it has grown to fit the largest message encoding more
+// messages does not touch the heap. destructors are never run, only
+// trivially destructible objects belong here.
+class Arena {
+  static constexpr size_t DEFAULT_CHUNK_SIZE = 1 << 16;
+
+  struct Chunk {
+    std::unique_ptr<char[]> data;
+    size_t size;
+  };
+
+  std::vector<Chunk> chunks_;
+  size_t chunk_ = 0;
+  size_t offset_ = 0;
+  size_t used_ = 0;
+  size_t high_water_mark_ = 0;
+
+  void add_chunk(size_t size) {
+    chunks_.push_back(Chunk{std::unique_ptr<char[]>(new char[size]), size});
+  }
+
+public:
+  Arena() = default;
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+  Arena(Arena &&) = default;
+  Arena &operator=(Arena &&) = default;
+
+  void *allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+    while(1) {
+      if(chunk_ < chunks_.size()) {
+        auto &c = chunks_[chunk_];
+        auto base = reinterpret_cast<uintptr_t>(c.data.get());
+        size_t start = ((base + offset_ + align - 1) & ~uintptr_t(align - 1)) - base;
+        if(start + size <= c.size) {
+          used_ += start + size - offset_;
+          offset_ = start + size;
+          high_water_mark_ = std::max(high_water_mark_, used_);
+          return c.data.get() + start;
+        }
+        // count the unused tail, the next message will get it back as one chunk
+        used_ += c.size - offset_;
+        ++chunk_, offset_ = 0;
+        continue;
+      }
+      add_chunk(std::max(size_t(DEFAULT_CHUNK_SIZE), size + align));
+    }
+  }
+
+  template <typename T, typename... Args>
+  T *make(Args &&...args) {
+    static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+    return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+  }
+
+  // value-initialized array
+  template <typename T>
+  T *make_array(size_t n) {
+    static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+    T *p = static_cast<T *>(allocate(sizeof(T) * n, alignof(T)));
+    for(size_t i = 0; i < n; ++i) {
+      new (p + i) T();
+    }
+    return p;
+  }
+
+  // invalidates everything allocated so far; if the last message did not
+  // fit into one chunk the chunks are merged so that the next one will
+  void reset() {
+    if(chunks_.size() > 1) {
+      chunks_.clear();
+      add_chunk(high_water_mark_);
+    }
+    chunk_ = 0, offset_ = 0, used_ = 0;
+  }
+
+  // the most memory any message has needed since construction
+  size_t high_water_mark() const noexcept {
+    return high_water_mark_;
+  }
+
+  size_t capacity() const noexcept {
+    size_t total = 0;
+    for(auto &c : chunks_) {
+      total += c.size;
+    }
+    return total;
+  }
+};
+
+// standard allocator on top of an arena, deallocation is a no-op
+template <typename T>
+struct ArenaAllocator {
+  using value_type = T;
+
+  Arena *arena;
+
+  ArenaAllocator(Arena &arena) noexcept:
+    arena(&arena)
+  {}
+
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U> &other) noexcept:
+    arena(other.arena)
+  {}
+
+  T *allocate(size_t n) {
+    return static_cast<T *>(arena->allocate(sizeof(T) * n, alignof(T)));
+  }
+
+  void deallocate(T *, size_t) noexcept {}
+
+  template <typename U>
+  bool operator==(const ArenaAllocator<U> &other) const noexcept {
+    return arena == other.arena;
+  }
+
+  template <typename U>
+  bool operator!=(const ArenaAllocator<U> &other) const noexcept {
+    return arena != other.arena;
+  }
+};
+
+template <typename T>
+using arena_vector = std::vector<T, ArenaAllocator<T>>;
+
+} // namespace coding
+
+#endif /* end of include guard: CODINGARENA_HPP */
@@ -2,10 +2,15 @@
 #define CODINGARITHMETIC_HPP
 
 #include <cassert>
+#include <cmath>
 #include <cstdint>
+#include <algorithm>
+#include <memory>
 #include <vector>
 
 #include <Base.hpp>
+#include <Model.hpp>
+#include <Trace.hpp>
 
 namespace coding {
 
@@ -51,6 +56,11 @@ struct multi_interval {
     psums.push_back(U(1));
   }
 
+  // sums computed before, n + 1 of them
+  multi_interval(const T *sums, size_t n):
+    psums(sums, sums + n + 1)
+  {}
+
   size_t find(T value) const {
     for(int i = 0; i < psums.size(); ++i) {
       if(value <= psums[i]) {
@@ -72,12 +82,18 @@ struct multi_interval {
   }
 };
 
-struct Arithmetic {
-  const CodingMeta &meta;
+template <typename Sym>
+struct BasicArithmetic {
+  using meta_type = BasicCodingMeta<Sym>;
+  using string_type = typename meta_type::string_type;
+
+  // keeps a shared model alive, meta refers to it
+  std::shared_ptr<const meta_type> shared_meta;
+  const meta_type &meta;
 
   using mask_t = uint64_t;
   #define NUM_BITS 53
-  static constexpr char END_OF_TEXT = EOF;
+  static constexpr Sym END_OF_TEXT = Sym(EOF);
   constexpr static mask_t fix_mask = ~mask_t(0) >> (sizeof(mask_t) * CHAR_BIT - NUM_BITS);
 
   static constexpr bool msb(mask_t x) {
@@ -100,27 +116,69 @@ struct Arithmetic {
     return (x << 1) & fix_mask;
   }
 
-  int pending_bits = 0;
+  // per-message encoder state: the interval and the bits waiting for it
+  // to leave the middle of the range. the codec itself only holds the
+  // model, so one codec serves any number of encoders at once
+  struct Encoder {
+    interval<mask_t> lu = interval<mask_t>(0, fix_mask);
+    int pending_bits = 0;
+  };
+
+  multi_interval<double> lr_;
+  // the message encoded by begin, encode_more and finish
+  Encoder state_;
+  // optional instrumentation, not to be shared between threads
+  Trace *trace = nullptr;
+
+  BasicArithmetic(const meta_type &meta):
+    meta(meta),
+    lr_(meta.probabilities())
+  {}
 
-  Arithmetic(const CodingMeta &meta):
-    meta(meta)
+  BasicArithmetic(std::shared_ptr<const meta_type> meta):
+    BasicArithmetic(*meta)
+  {
+    shared_meta = std::move(meta);
+  }
+
+  // the prefix sums of a compiled model, copied
+  BasicArithmetic(const meta_type &meta, const CompiledModel &model):
+    meta(meta),
+    lr_(sums(meta, model), meta.size())
   {}
 
-  void rescale_a(interval<mask_t> &lu) {
+  static const double *sums(const meta_type &meta, const CompiledModel &model) {
+    if(!model.matches(meta)) {
+      throw std::runtime_error("the compiled model is of another alphabet or probabilities");
+    }
+    return model.section<double>(CompiledModel::ARITHMETIC_SUMS, meta.size() + 1);
+  }
+
+  void save(ModelImage &image) const {
+    image.add(CompiledModel::ARITHMETIC_SUMS, lr_.psums);
+  }
+
+  struct Stats {
+    uint64_t rescales_a = 0;
+    uint64_t rescales_b = 0;
+    int max_pending = 0;
+  };
+
+  static void rescale_a(interval<mask_t> &lu) {
     lu = {
       lshift(lu.l),
       lshift(lu.r) | 1
     };
   }
 
-  void rescale_b(interval<mask_t> &lu) {
+  static void rescale_b(interval<mask_t> &lu) {
     lu = {
       unset_msb(lshift(lu.l)),
       set_msb(lshift(lu.r) | 1)
     };
   }
 
-  void output_bits(DynamicBitset &bset, bool bit, int n) {
+  static void output_bits(DynamicBitset &bset, bool bit, int n) {
     while(n > 32) {
       bset.append<uint32_t>(bit ? ~uint32_t(0) : 0);
       n -= 32;
@@ -139,69 +197,147 @@ struct Arithmetic {
     }
   }
 
-  DynamicBitset encode(const std::string &text) {
-    DynamicBitset bset;
-    if(meta.alphabet().find(END_OF_TEXT) == std::string::npos) {
-      throw std::domain_error("unable to find end-of-text symbol");
-    }
-    auto len = meta.size();
-
-    pending_bits = 0;
-    interval<mask_t> lu(0, fix_mask);
-    multi_interval<double> lr(meta.probabilities());
-
+  // narrows the interval to the symbol and shifts out the settled bits
+  void encode_symbol(interval<mask_t> &lu, int &pending, size_t ind, DynamicBitset &bset, Stats &stats) const {
     auto &l = lu.left(), &u = lu.right();
-
-    for(int i = 0; i < text.length(); ++i) {
-      auto ind = meta.find_char(text[i]);
-      interval<const double &> &&p = lr[ind];
-      auto diff = (lu.diff() + 1);
-      lu = {
-        l + mask_t(p.l * diff),
-        l + mask_t(p.r * diff) - 1
-      };
-      while(msb(l) == msb(u) || (msb2(l) && !msb2(u))) {
-        if(msb(l) == msb(u)) {
-          // rescale_a
-          auto b = msb(l);
-          bset.append_bit(b);
-          output_bits(bset, !b, pending_bits);
-          pending_bits = 0;
-          rescale_a(lu);
-        } else if(msb2(l) && !msb2(u)) {
-          // rescale_b
-          rescale_b(lu);
-          ++pending_bits;
-        }
+    interval<const double &> &&p = lr_[ind];
+    auto diff = (lu.diff() + 1);
+    lu = {
+      l + mask_t(p.l * diff),
+      l + mask_t(p.r * diff) - 1
+    };
+    while(msb(l) == msb(u) || (msb2(l) && !msb2(u))) {
+      if(msb(l) == msb(u)) {
+        // rescale_a
+        auto b = msb(l);
+        bset.append_bit(b);
+        output_bits(bset, !b, pending);
+        stats.max_pending = std::max(stats.max_pending, pending);
+        pending = 0;
+        rescale_a(lu);
+        ++stats.rescales_a;
+      } else if(msb2(l) && !msb2(u)) {
+        // rescale_b
+        rescale_b(lu);
+        ++pending;
+        ++stats.rescales_b;
       }
     }
-    auto b = msb(l);
+  }
+
+  // the bits that settle the interval, trailing zeros dropped. the bits
+  // shifted out before stay, so that the decoder knows how far it may read
+  static void flush(const interval<mask_t> &lu, int pending, DynamicBitset &bset) {
+    const size_t settled = bset.size();
+    auto b = msb(lu.l);
     bset.append_bit(b);
-    output_bits(bset, !b, pending_bits);
-    bset.append(std::bitset<NUM_BITS-1>(l));
+    output_bits(bset, !b, pending);
     for(int i = 0; i < NUM_BITS - 1; ++i) {
       mask_t bit = mask_t(1) << (NUM_BITS - i - 2);
-      bset.append_bit(l & bit);
+      bset.append_bit(lu.l & bit);
     }
-    while(!bset[bset.size() - 1]) {
+    while(bset.size() > settled && !bset[bset.size() - 1]) {
       bset.pop();
     }
+  }
+
+  void begin() {
+    state_ = Encoder();
+  }
+
+  void encode_more(const string_type &text, DynamicBitset &bset) {
+    encode_more(state_, text, bset);
+  }
+
+  void finish(DynamicBitset &bset) const {
+    finish(state_, bset);
+  }
+
+  // appends the settled bits of more text; the rest stays in the interval
+  // until finish
+  void encode_more(Encoder &e, const string_type &text, DynamicBitset &bset) const {
+    Trace::Timer timer(trace, "arithmetic.encode");
+    if(meta.find_char(END_OF_TEXT) == meta_type::npos) {
+      throw std::domain_error("unable to find end-of-text symbol");
+    }
+    Stats stats;
+    for(size_t i = 0; i < text.size(); ++i) {
+      auto ind = meta.find_char(text[i]);
+      if(ind == meta_type::npos) {
+        throw std::domain_error("symbol outside of the alphabet");
+      }
+      encode_symbol(e.lu, e.pending_bits, ind, bset, stats);
+    }
+    stats.max_pending = std::max(stats.max_pending, e.pending_bits);
+    if(trace) {
+      trace->count("arithmetic.rescale_a", stats.rescales_a);
+      trace->count("arithmetic.rescale_b", stats.rescales_b);
+      trace->peak("arithmetic.pending_bits", stats.max_pending);
+    }
+  }
+
+  // ends a piecewise message with the end of text and the settling bits.
+  // the state is left as it was, so the message can still grow: append
+  // to a copy of the bits to keep encoding into the original
+  void finish(const Encoder &e, DynamicBitset &bset) const {
+    auto lu = e.lu;
+    int pending = e.pending_bits;
+    Stats stats;
+    encode_symbol(lu, pending, meta.find_char(END_OF_TEXT), bset, stats);
+    flush(lu, pending, bset);
+  }
+
+  // bits of a message of n symbols at most, the end of text included.
+  // the interval is wider than a quarter before every symbol and is
+  // doubled once per output bit until it is wider than a half again
+  size_t max_encoded_size(size_t n) const {
+    float least = 1.f;
+    for(size_t i = 0; i < meta.size(); ++i) {
+      if(meta.get_prob(i) > 0.f) {
+        least = std::min(least, meta.get_prob(i));
+      }
+    }
+    return n * (size_t(std::ceil(-std::log2(least))) + 2) + NUM_BITS;
+  }
+
+  // the text must end with END_OF_TEXT
+  DynamicBitset encode(const string_type &text) const {
+    DynamicBitset bset;
+    encode(text, bset);
     return bset;
   }
 
-  bool get_bit(const DynamicBitset &bset, int i) {
-    return bset[i] ? 1 : 0;
+  // into a reused buffer, returns the number of bits
+  size_t encode(const string_type &text, DynamicBitset &bset) const {
+    bset.clear();
+    Encoder e;
+    encode_more(e, text, bset);
+    flush(e.lu, e.pending_bits, bset);
+    return bset.size();
+  }
+
+  // trailing zeros are dropped by the encoder
+  static bool get_bit(const DynamicBitset &bset, int i) {
+    return (i < bset.size() && bset[i]) ? 1 : 0;
   }
 
-  mask_t push(mask_t v, bool bit) {
+  static mask_t push(mask_t v, bool bit) {
     return lshift(v) | (bit ? 1 : 0);
   }
 
-  std::string decode(const DynamicBitset &bset) {
-    std::string s;
+  string_type decode(const DynamicBitset &bset) const {
+    string_type s;
+    decode(bset, s);
+    return s;
+  }
+
+  // into a reused buffer, returns the number of symbols
+  size_t decode(const DynamicBitset &bset, string_type &s) const {
+    Trace::Timer timer(trace, "arithmetic.decode");
+    s.clear();
 
     interval<mask_t> lu(0, fix_mask);
-    multi_interval<double> lr(meta.probabilities());
+    const auto &lr = lr_;
     mask_t v = 0x0;
     auto str_bit = [=](mask_t val) {
       std::string s = "";
@@ -215,43 +351,64 @@ struct Arithmetic {
     for(i = 0; i < NUM_BITS; ++i) {
       v = push(v, get_bit(bset, i));
     }
+    // the decoder reads NUM_BITS ahead of the encoder and one bit per
+    // pending bit, so i - NUM_BITS - pending is where the encoder was.
+    // the encoder keeps everything it shifted out, so past the end of
+    // the bits the message was cut short
+    size_t pending = 0;
     while(1) {
       if(lu.l > lu.r) {
         throw std::runtime_error("wtf?!");
       }
       auto diff = lu.right() - lu.left() + 1;
-      auto p_v = double(v - lu.l + 1) / diff;
-      auto id = lr.find(p_v);
+      // the symbol whose subinterval, rounded as by the encoder, holds v
+      size_t lo = 0, hi = lr.size() - 1;
+      while(lo < hi) {
+        const size_t mid = (lo + hi + 1) / 2;
+        if(lu.l + mask_t(lr.psums[mid] * diff) <= v) {
+          lo = mid;
+        } else {
+          hi = mid - 1;
+        }
+      }
+      const size_t id = lo;
       auto &&p = lr[id];
       lu = {
         lu.l + mask_t(p.l * diff),
         lu.l + mask_t(p.r * diff) - 1
       };
       auto c = meta.get_char(id);
-      s += c;
+      s.push_back(c);
       if(c == END_OF_TEXT) {
         break;
       }
       while(msb(lu.l) == msb(lu.r) || (msb2(lu.l) && !msb2(lu.r))) {
-        if(i >= bset.size()) {
-          break;
-        }
         if(msb(lu.l) == msb(lu.r)) {
           rescale_a(lu);
           v = push(v, get_bit(bset, i++));
+          pending = 0;
         } else {
           rescale_b(lu);
           v = push(v, get_bit(bset, i++)) ^ (mask_t(1) << (NUM_BITS - 1));
+          ++pending;
+        }
+        if(i - NUM_BITS - pending > bset.size()) {
+          throw std::domain_error("unable to fully decode the text");
         }
       }
     }
 
-    return s;
+    return s.size();
   }
 
   #undef NUM_BITS
 };
 
+template <typename Sym>
+constexpr Sym BasicArithmetic<Sym>::END_OF_TEXT;
+
+using Arithmetic = BasicArithmetic<char>;
+
 } // namespace coding
 
 #endif /* end of include guard: CODINGARITHMETIC_HPP */
@@ -0,0 +1,380 @@
+#ifndef CODINGAUTO_HPP
+#define CODINGAUTO_HPP
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include <Base.hpp>
+#include <Huffman.hpp>
+#include <Arithmetic.hpp>
+#include <LZ77.hpp>
+#include <LZW.hpp>
+#include <Trace.hpp>
+
+namespace coding {
+
+// picks a codec for every block from a sample of it instead of trying them
+// all: the sample's histogram prices the entropy coders under the model, a
+// greedy parse against a hash of last occurrences prices LZ77 and a count
+// of new phrases prices LZW.
+//
+// layout per block: codec id, block length, payload length in bits, the
+// code width for LZW, then the payload
+struct Auto {
+  enum class Codec : uint8_t {
+    Base, Huffman, Arithmetic, LZ77, LZW
+  };
+  static constexpr int NUM_CODECS = 5;
+  static constexpr int CODEC_BITS = 3;
+  static constexpr int LENGTH_BITS = 32;
+  static constexpr int WIDTH_BITS = 6;
+  static constexpr size_t DEFAULT_BLOCK_SIZE = 1 << 16;
+  static constexpr size_t MAX_BLOCK_SIZE = 1 << 24;
+  // symbols sampled per block, in slices long enough to hold repeats
+  static constexpr size_t SAMPLE_SIZE = 4096;
+  static constexpr size_t SAMPLE_SLICES = 4;
+  // given to the end of text when the model has none
+  static constexpr float END_OF_TEXT_PROBABILITY = 1e-3f;
+
+  // keeps a shared model alive, meta refers to it
+  std::shared_ptr<const CodingMeta> shared_meta;
+  const CodingMeta &meta;
+  const size_t block_size;
+  // codec of every block of the last message
+  std::vector<Codec> choices;
+  double avglen = 0.;
+  // optional instrumentation
+  Trace *trace = nullptr;
+
+  // the model with an end of text for the arithmetic coder
+  std::string arith_alphabet;
+  std::vector<float> arith_probabilities;
+  std::unique_ptr<CodingMeta> arith_meta;
+
+  coding::Base base;
+  coding::Huffman huffman;
+  std::unique_ptr<coding::Arithmetic> arithmetic;
+  coding::LZ77 lz77;
+  coding::LZW lzw;
+
+  // per byte: huffman code length and arithmetic cost in bits, the latter
+  // infinite for symbols the model can not code
+  std::array<double, 256> code_length;
+  std::array<double, 256> arith_cost;
+
+  Auto(const CodingMeta &meta, size_t block_size = DEFAULT_BLOCK_SIZE):
+    meta(meta),
+    block_size(block_size),
+    base(meta),
+    huffman(meta),
+    lz77(meta),
+    lzw(meta)
+  {
+    if(block_size == 0 || block_size > MAX_BLOCK_SIZE) {
+      throw std::runtime_error("block size out of range");
+    }
+    const double inf = std::numeric_limits<double>::infinity();
+    code_length.fill(inf);
+    arith_cost.fill(inf);
+    if(meta.size() == 0) {
+      return;
+    }
+    for(size_t i = 0; i < meta.size(); ++i) {
+      code_length[uint8_t(huffman.symbols_[i])] = std::max<size_t>(1, huffman.leaves_[i].depth());
+    }
+    arith_alphabet = meta.alphabet();
+    arith_probabilities = meta.probabilities();
+    if(meta.find_char(Arithmetic::END_OF_TEXT) == CodingMeta::npos) {
+      for(auto &p : arith_probabilities) {
+        p *= 1.f - END_OF_TEXT_PROBABILITY;
+      }
+      arith_alphabet += Arithmetic::END_OF_TEXT;
+      arith_probabilities.push_back(float(END_OF_TEXT_PROBABILITY));
+    }
+    arith_meta.reset(new CodingMeta(arith_alphabet, arith_probabilities));
+    arithmetic.reset(new coding::Arithmetic(*arith_meta));
+    for(size_t i = 0; i < arith_meta->size(); ++i) {
+      const auto c = arith_meta->get_char(i);
+      const auto p = arith_meta->get_prob(i);
+      // the end of text only ends a block
+      if(c != Arithmetic::END_OF_TEXT && p > 0.f) {
+        arith_cost[uint8_t(c)] = -std::log2(p);
+      }
+    }
+  }
+
+  Auto(std::shared_ptr<const CodingMeta> meta, size_t block_size = DEFAULT_BLOCK_SIZE):
+    Auto(*meta, block_size)
+  {
+    shared_meta = std::move(meta);
+  }
+
+  static const char *codec_name(Codec codec) noexcept {
+    switch(codec) {
+      case Codec::Base: return "base";
+      case Codec::Huffman: return "huffman";
+      case Codec::Arithmetic: return "arithmetic";
+      case Codec::LZ77: return "lz77";
+      case Codec::LZW: return "lzw";
+    }
+    return "unknown";
+  }
+
+  // estimated bits of every codec for a block, header included
+  std::array<double, NUM_CODECS> estimate(const char *text, size_t n) const {
+    const double inf = std::numeric_limits<double>::infinity();
+    std::array<double, NUM_CODECS> bits;
+    bits.fill(inf);
+    const double header = CODEC_BITS + 2 * LENGTH_BITS;
+    bits[int(Codec::Base)] = header + 8. * n;
+    if(n == 0 || meta.size() == 0) {
+      return bits;
+    }
+    // evenly spaced slices, or the whole block if it is small
+    const size_t slices = n <= SAMPLE_SIZE ? 1 : SAMPLE_SLICES;
+    const size_t slice = n <= SAMPLE_SIZE ? n : SAMPLE_SIZE / SAMPLE_SLICES;
+    const double scale = double(n) / double(slices * slice);
+
+    // entropy coders
+    uint64_t counts[256] = {};
+    for(size_t k = 0; k < slices; ++k) {
+      const char *p = text + (slices > 1 ? k * (n - slice) / (slices - 1) : 0);
+      for(size_t i = 0; i < slice; ++i) {
+        ++counts[uint8_t(p[i])];
+      }
+    }
+    double huffman_bits = 0., arith_bits = 0.;
+    for(int c = 0; c < 256; ++c) {
+      if(counts[c]) {
+        huffman_bits += counts[c] * code_length[c];
+        arith_bits += counts[c] * arith_cost[c];
+      }
+    }
+    bits[int(Codec::Huffman)] = header + scale * huffman_bits;
+    if(arith_meta) {
+      const auto eot = arith_meta->get_prob(arith_meta->find_char(Arithmetic::END_OF_TEXT));
+      // the end of text and the bits that flush the interval
+      bits[int(Codec::Arithmetic)] = header + scale * arith_bits - std::log2(eot) + 2.;
+    }
+
+    // LZ77: greedy parse with the window and code widths of the whole block
+    const int bits_sym = coding::LZ77::ceil_log2(meta.size());
+    const int lookahead = std::min<int>(n, std::max<int>(10 + std::log(n), 15));
+    const int window = std::cbrt(n);
+    const int bits_match = 1 + coding::LZ77::ceil_log2(window) + coding::LZ77::ceil_log2(lookahead);
+    const int min_match = std::max<int>(int(HashChain::MIN_MATCH), bits_match / (1 + bits_sym) + 1);
+    uint64_t literals = 0, matches = 0;
+    std::vector<int32_t> last(1 << HashChain::HASH_BITS);
+    for(size_t k = 0; k < slices; ++k) {
+      const char *p = text + (slices > 1 ? k * (n - slice) / (slices - 1) : 0);
+      const int end = slice;
+      std::fill(last.begin(), last.end(), -1);
+      auto insert = [&](int pos) {
+        if(pos + HashChain::MIN_MATCH <= end) {
+          last[HashChain::hash(p + pos)] = pos;
+        }
+      };
+      for(int i = 0; i < end;) {
+        int len = 0;
+        if(i + HashChain::MIN_MATCH <= end) {
+          const int j = last[HashChain::hash(p + i)];
+          const int maxlen = std::min(lookahead - 1, end - i);
+          if(j >= 0 && i - j <= window) {
+            while(len < maxlen && p[j + len] == p[i + len]) {
+              ++len;
+            }
+          }
+        }
+        if(len >= min_match) {
+          for(int t = 0; t < len; ++t) {
+            insert(i + t);
+          }
+          ++matches;
+          i += len;
+        } else {
+          insert(i);
+          ++literals;
+          ++i;
+        }
+      }
+    }
+    bits[int(Codec::LZ77)] = header + scale * (literals * (1. + bits_sym) + matches * double(bits_match));
+
+    // LZW: phrases of the sample, grown to the block like n / log n
+    std::unordered_map<uint64_t, uint64_t> phrases;
+    uint64_t size = meta.size(), codes = 0;
+    bool has_w = false;
+    uint64_t w = 0;
+    for(size_t k = 0; k < slices; ++k) {
+      const char *p = text + (slices > 1 ? k * (n - slice) / (slices - 1) : 0);
+      for(size_t i = 0; i < slice; ++i) {
+        const uint64_t c = uint8_t(p[i]);
+        if(!has_w) {
+          w = meta.find_char(p[i]), has_w = true;
+          continue;
+        }
+        auto it = phrases.find(w << 8 | c);
+        if(it != phrases.end()) {
+          w = it->second;
+        } else {
+          phrases.emplace(w << 8 | c, size++);
+          ++codes;
+          w = meta.find_char(p[i]);
+        }
+      }
+    }
+    const double m = slices * slice;
+    const double lzw_codes = (codes + 1) * scale * std::log2(std::max(m, 2.)) / std::log2(std::max(double(n), 2.));
+    const int width = coding::LZW::ceil_log2(long(meta.size() + lzw_codes));
+    bits[int(Codec::LZW)] = header + WIDTH_BITS + lzw_codes * width;
+    return bits;
+  }
+
+  Codec choose(const char *text, size_t n) const {
+    // codecs other than base need every symbol in the model
+    bool known = true, arith_known = bool(arith_meta);
+    for(size_t i = 0; i < n; ++i) {
+      const auto c = uint8_t(text[i]);
+      known = known && code_length[c] != std::numeric_limits<double>::infinity();
+      arith_known = arith_known && arith_cost[c] != std::numeric_limits<double>::infinity();
+    }
+    if(!known) {
+      return Codec::Base;
+    }
+    auto bits = estimate(text, n);
+    if(!arith_known) {
+      bits[int(Codec::Arithmetic)] = std::numeric_limits<double>::infinity();
+    }
+    return Codec(std::min_element(bits.begin(), bits.end()) - bits.begin());
+  }
+
+  void attach_trace() {
+    huffman.trace = lz77.trace = lzw.trace = trace;
+    if(arithmetic) {
+      arithmetic->trace = trace;
+    }
+  }
+
+  DynamicBitset encode_block(Codec codec, const std::string &block) {
+    switch(codec) {
+      case Codec::Base: return base.encode(block);
+      case Codec::Huffman: return huffman.encode(block);
+      case Codec::Arithmetic: return arithmetic->encode(block + Arithmetic::END_OF_TEXT);
+      case Codec::LZ77: return lz77.encode(block);
+      case Codec::LZW: return lzw.encode(block);
+    }
+    throw std::runtime_error("unknown codec");
+  }
+
+  static void put(DynamicBitset &bset, uint64_t x, int bits) {
+    for(int i = bits - 1; i >= 0; --i) {
+      bset.append_bit((x >> i) & 1);
+    }
+  }
+
+  DynamicBitset encode(const std::string &text) {
+    Trace::Timer timer(trace, "auto.encode");
+    attach_trace();
+    choices.clear();
+    DynamicBitset bset;
+    for(size_t from = 0; from < text.length(); from += block_size) {
+      const size_t n = std::min(block_size, text.length() - from);
+      const std::string block = text.substr(from, n);
+      Trace::Timer choose_timer(trace, "auto.choose");
+      auto codec = choose(block.data(), n);
+      choose_timer.stop();
+      auto payload = encode_block(codec, block);
+      // long codes on a large block may not fit the header
+      if(payload.size() >> LENGTH_BITS) {
+        codec = Codec::Base;
+        payload = base.encode(block);
+      }
+      choices.push_back(codec);
+      put(bset, uint64_t(codec), CODEC_BITS);
+      put(bset, n, LENGTH_BITS);
+      put(bset, payload.size(), LENGTH_BITS);
+      if(codec == Codec::LZW) {
+        put(bset, lzw.block_size, WIDTH_BITS);
+      }
+      bset.append(payload);
+      if(trace) {
+        trace->count(std::string("auto.") + codec_name(codec));
+      }
+    }
+    avglen = text.empty() ? 0. : double(bset.size()) / text.length();
+    return bset;
+  }
+
+  // bits per symbol of the last message, headers included
+  double average_length() {
+    return avglen;
+  }
+
+  std::string decode_block(Codec codec, const DynamicBitset &payload, size_t n, int width) {
+    switch(codec) {
+      case Codec::Base: return base.decode(payload);
+      case Codec::Huffman: return huffman.decode(payload);
+      case Codec::Arithmetic: {
+        if(!arithmetic) {
+          throw std::domain_error("unable to fully decode the text");
+        }
+        auto block = arithmetic->decode(payload);
+        block.pop_back();
+        return block;
+      }
+      case Codec::LZ77:
+        return lz77.decode(payload, lz77.window_for(n));
+      case Codec::LZW:
+        return lzw.decode(payload, width);
+    }
+    throw std::domain_error("unknown codec");
+  }
+
+  std::string decode(const DynamicBitset &bset) {
+    Trace::Timer timer(trace, "auto.decode");
+    attach_trace();
+    std::string s;
+    size_t pos = 0;
+    while(pos < bset.size()) {
+      if(pos + CODEC_BITS + 2 * LENGTH_BITS > bset.size()) {
+        throw std::domain_error("truncated block header");
+      }
+      const auto id = bset.get_bits(pos, CODEC_BITS);
+      pos += CODEC_BITS;
+      if(id >= NUM_CODECS) {
+        throw std::domain_error("unknown codec");
+      }
+      const auto codec = Codec(id);
+      const size_t n = bset.get_bits(pos, LENGTH_BITS);
+      pos += LENGTH_BITS;
+      const size_t bits = bset.get_bits(pos, LENGTH_BITS);
+      pos += LENGTH_BITS;
+      int width = 0;
+      if(codec == Codec::LZW) {
+        width = bset.get_bits(pos, WIDTH_BITS);
+        pos += WIDTH_BITS;
+      }
+      if(pos + bits > bset.size()) {
+        throw std::domain_error("truncated block");
+      }
+      auto block = decode_block(codec, bset.slice(pos, bits), n, width);
+      pos += bits;
+      if(block.length() != n) {
+        throw std::domain_error("unable to fully decode the text");
+      }
+      s += block;
+    }
+    return s;
+  }
+};
+
+} // namespace coding
+
+#endif /* end of include guard: CODINGAUTO_HPP */
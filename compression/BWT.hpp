@@ -0,0 +1,468 @@
+#ifndef CODINGBWT_HPP
+#define CODINGBWT_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include <Base.hpp>
+#include <Arena.hpp>
+#include <Histogram.hpp>
+#include <Huffman.hpp>
+#include <Arithmetic.hpp>
+#include <Trace.hpp>
+
+namespace coding {
+
+namespace detail {
+
+// suffix array by induced sorting (SA-IS), linear time. s holds n symbols
+// in [0, k), the last one is a unique smallest sentinel.
+template <typename T>
+void sais(const T *s, int32_t *sa, int32_t n, int32_t k, Arena &arena) {
+  // S-type suffixes are smaller than their successor
+  auto stype = arena.make_array<bool>(n);
+  stype[n - 1] = true;
+  for(int32_t i = n - 2; i >= 0; --i) {
+    stype[i] = s[i] < s[i + 1] || (s[i] == s[i + 1] && stype[i + 1]);
+  }
+  auto is_lms = [&](int32_t i) {
+    return i > 0 && stype[i] && !stype[i - 1];
+  };
+  auto counts = arena.make_array<int32_t>(k);
+  for(int32_t i = 0; i < n; ++i) {
+    ++counts[s[i]];
+  }
+  auto bucket = arena.make_array<int32_t>(k);
+  auto bucket_heads = [&]() {
+    for(int32_t c = 0, sum = 0; c < k; ++c) {
+      bucket[c] = sum, sum += counts[c];
+    }
+  };
+  auto bucket_tails = [&]() {
+    for(int32_t c = 0, sum = 0; c < k; ++c) {
+      sum += counts[c], bucket[c] = sum;
+    }
+  };
+  auto induce = [&]() {
+    bucket_heads();
+    for(int32_t i = 0; i < n; ++i) {
+      int32_t j = sa[i] - 1;
+      if(j >= 0 && !stype[j]) {
+        sa[bucket[s[j]]++] = j;
+      }
+    }
+    bucket_tails();
+    for(int32_t i = n - 1; i >= 0; --i) {
+      int32_t j = sa[i] - 1;
+      if(j >= 0 && stype[j]) {
+        sa[--bucket[s[j]]] = j;
+      }
+    }
+  };
+
+  // sort the LMS substrings
+  std::fill(sa, sa + n, -1);
+  bucket_tails();
+  for(int32_t i = 1; i < n; ++i) {
+    if(is_lms(i)) {
+      sa[--bucket[s[i]]] = i;
+    }
+  }
+  induce();
+
+  // name them, equal substrings get equal names
+  int32_t n1 = 0;
+  for(int32_t i = 0; i < n; ++i) {
+    if(is_lms(sa[i])) {
+      sa[n1++] = sa[i];
+    }
+  }
+  std::fill(sa + n1, sa + n, -1);
+  int32_t name = 0, prev = -1;
+  for(int32_t i = 0; i < n1; ++i) {
+    const int32_t pos = sa[i];
+    bool diff = false;
+    for(int32_t d = 0;; ++d) {
+      if(prev == -1 || s[pos + d] != s[prev + d] || stype[pos + d] != stype[prev + d]) {
+        diff = true;
+        break;
+      } else if(d > 0 && (is_lms(pos + d) || is_lms(prev + d))) {
+        break;
+      }
+    }
+    if(diff) {
+      ++name, prev = pos;
+    }
+    sa[n1 + pos / 2] = name - 1;
+  }
+  for(int32_t i = n - 1, j = n - 1; i >= n1; --i) {
+    if(sa[i] >= 0) {
+      sa[j--] = sa[i];
+    }
+  }
+
+  // sort the LMS suffixes, recursing while names are not unique
+  int32_t *s1 = sa + n - n1;
+  if(name < n1) {
+    sais(s1, sa, n1, name, arena);
+  } else {
+    for(int32_t i = 0; i < n1; ++i) {
+      sa[s1[i]] = i;
+    }
+  }
+
+  // induce the whole array from the sorted LMS suffixes
+  for(int32_t i = 1, j = 0; i < n; ++i) {
+    if(is_lms(i)) {
+      s1[j++] = i;
+    }
+  }
+  for(int32_t i = 0; i < n1; ++i) {
+    sa[i] = s1[sa[i]];
+  }
+  std::fill(sa + n1, sa + n, -1);
+  bucket_tails();
+  for(int32_t i = n1 - 1; i >= 0; --i) {
+    int32_t j = sa[i];
+    sa[i] = -1;
+    sa[--bucket[s[j]]] = j;
+  }
+  induce();
+}
+
+} // namespace detail
+
+// block sorting compressor: every block goes through the burrows-wheeler
+// transform, move-to-front and zero run length coding, the resulting
+// symbols of all blocks are then entropy coded by Coder (Huffman or
+// Arithmetic) with a model fitted to them
+//
+// layout: the number of blocks; per block its length, the row of its text
+// and its number of stage symbols; the count of every stage symbol but
+// the end of text, all in LENGTH_BITS; then the code of the stage. the
+// model of the stage is built from the counts on both sides.
+template <typename Coder = Huffman>
+struct BWT {
+  static constexpr size_t DEFAULT_BLOCK_SIZE = 900000;
+  // rows of the inverse transform pack the next row above the symbol
+  static constexpr size_t MAX_BLOCK_SIZE = (size_t(1) << 24) - 2;
+  // zero runs are written in bijective base 2 with two digits
+  static constexpr int RUNA = 0, RUNB = 1;
+  static constexpr bool terminated = std::is_same<Coder, Arithmetic>::value;
+  static constexpr int LENGTH_BITS = 32;
+
+  // where a block is in the stage and what its inverse transform needs
+  struct BlockHeader {
+    uint32_t length;
+    uint32_t primary;
+    uint32_t stage_length;
+  };
+
+  // keeps a shared model alive, meta refers to it
+  std::shared_ptr<const CodingMeta> shared_meta;
+  const CodingMeta &meta;
+  size_t block_size;
+  double avglen = 0.;
+  // suffix arrays and transforms, rewound per block
+  Arena scratch;
+  // optional instrumentation, handed on to the entropy coder
+  Trace *trace = nullptr;
+
+  BWT(const CodingMeta &meta, size_t block_size = DEFAULT_BLOCK_SIZE):
+    meta(meta),
+    block_size(block_size)
+  {
+    if(block_size == 0 || block_size > MAX_BLOCK_SIZE) {
+      throw std::runtime_error("invalid block size " + std::to_string(block_size));
+    }
+    if(meta.size() + 1 + (terminated ? 1 : 0) > 256) {
+      throw std::domain_error("alphabet too large for the block sorting stage");
+    }
+  }
+
+  BWT(std::shared_ptr<const CodingMeta> meta, size_t block_size = DEFAULT_BLOCK_SIZE):
+    BWT(*meta, block_size)
+  {
+    shared_meta = std::move(meta);
+  }
+
+  // burrows-wheeler transform of n alphabet indices; returns the row of
+  // the text itself, which has the sentinel as its last symbol
+  uint32_t transform(const uint8_t *text, int32_t n, uint8_t *last) {
+    auto s = scratch.make_array<uint16_t>(n + 1);
+    for(int32_t i = 0; i < n; ++i) {
+      s[i] = text[i] + 1;
+    }
+    s[n] = 0;
+    auto sa = scratch.make_array<int32_t>(n + 1);
+    detail::sais(s, sa, n + 1, meta.size() + 1, scratch);
+    uint32_t row = 0;
+    for(int32_t i = 0, j = 0; i <= n; ++i) {
+      if(sa[i] == 0) {
+        row = i;
+      } else {
+        last[j++] = text[sa[i] - 1];
+      }
+    }
+    return row;
+  }
+
+  // LF-mapping with the next row and the symbol packed into one word, so
+  // that each output symbol costs a single random access
+  void inverse(const uint8_t *last, int32_t n, uint32_t row, uint8_t *text) {
+    auto rows = scratch.make_array<uint32_t>(n + 1);
+    int32_t counts[256] = {};
+    for(int32_t i = 0; i < n; ++i) {
+      ++counts[last[i]];
+    }
+    // the sentinel sorts first
+    int32_t next[256];
+    for(int c = 0, sum = 1; c < 256; ++c) {
+      next[c] = sum, sum += counts[c];
+    }
+    for(int32_t i = 0; i <= n; ++i) {
+      if(uint32_t(i) == row) {
+        rows[0] |= uint32_t(i) << 8;
+      } else {
+        const auto c = last[i - (uint32_t(i) > row)];
+        rows[i] |= c;
+        rows[next[c]++] |= uint32_t(i) << 8;
+      }
+    }
+    uint32_t pos = rows[row] >> 8;
+    for(int32_t i = 0; i < n; ++i) {
+      const uint32_t r = rows[pos];
+      text[i] = r & 0xFF;
+      pos = r >> 8;
+    }
+  }
+
+  static void put(DynamicBitset &bset, uint64_t x, int bits) {
+    for(int i = bits - 1; i >= 0; --i) {
+      bset.append_bit((x >> i) & 1);
+    }
+  }
+
+  // stage symbols are 0 to meta.size(), the end of text comes apart
+  size_t stage_symbols() const noexcept {
+    return meta.size() + 1;
+  }
+
+  DynamicBitset encode(const std::string &text) {
+    std::vector<BlockHeader> blocks;
+    int16_t index[256];
+    std::fill(index, index + 256, -1);
+    for(size_t i = 0; i < meta.size(); ++i) {
+      index[uint8_t(meta.get_char(i))] = i;
+    }
+    std::string stage;
+    for(size_t from = 0; from < text.length(); from += block_size) {
+      scratch.reset();
+      const int32_t n = std::min(block_size, text.length() - from);
+      auto block = scratch.make_array<uint8_t>(n);
+      for(int32_t i = 0; i < n; ++i) {
+        const auto x = index[uint8_t(text[from + i])];
+        if(x < 0) {
+          throw std::domain_error("symbol outside of the alphabet");
+        }
+        block[i] = x;
+      }
+      auto last = scratch.make_array<uint8_t>(n);
+      Trace::Timer sort_timer(trace, "bwt.sort");
+      blocks.push_back(BlockHeader{uint32_t(n), transform(block, n, last), 0});
+      sort_timer.stop();
+      // move-to-front, runs of zeros in bijective base 2
+      Trace::Timer mtf_timer(trace, "bwt.mtf");
+      const size_t before = stage.length();
+      uint8_t order[256];
+      for(int c = 0; c < 256; ++c) {
+        order[c] = c;
+      }
+      uint32_t run = 0;
+      auto flush = [&]() {
+        while(run > 0) {
+          const int digit = (run & 1) ? RUNA : RUNB;
+          stage += char(digit);
+          run = (run - (digit + 1)) >> 1;
+        }
+      };
+      for(int32_t i = 0; i < n; ++i) {
+        const auto c = last[i];
+        if(order[0] == c) {
+          ++run;
+          continue;
+        }
+        flush();
+        int j = 1;
+        while(order[j] != c) {
+          ++j;
+        }
+        std::memmove(order + 1, order, j);
+        order[0] = c;
+        stage += char(j + 1);
+      }
+      flush();
+      blocks.back().stage_length = stage.length() - before;
+    }
+    // an empty message needs no model
+    if(blocks.empty()) {
+      avglen = 0.;
+      return DynamicBitset();
+    }
+    DynamicBitset bset;
+    put(bset, blocks.size(), LENGTH_BITS);
+    for(auto &b : blocks) {
+      put(bset, b.length, LENGTH_BITS);
+      put(bset, b.primary, LENGTH_BITS);
+      put(bset, b.stage_length, LENGTH_BITS);
+    }
+    Histogram hist(stage);
+    for(size_t c = 0; c < stage_symbols(); ++c) {
+      put(bset, hist.counts[c], LENGTH_BITS);
+    }
+    // entropy code the stage with its own statistics
+    const char eot = Arithmetic::END_OF_TEXT;
+    if(terminated) {
+      stage += eot;
+      hist.add(&eot, 1);
+    }
+    auto stage_alphabet = hist.alphabet();
+    auto stage_probabilities = hist.probabilities(stage_alphabet);
+    const CodingMeta stage_meta(stage_alphabet, stage_probabilities);
+    Coder coder(stage_meta);
+    coder.trace = trace;
+    bset.append(coder.encode(stage));
+    if(trace) {
+      trace->count("bwt.blocks", blocks.size());
+      trace->count("bwt.stage_symbols", stage.length());
+    }
+    avglen = text.empty() ? 0. : double(bset.size()) / text.length();
+    return bset;
+  }
+
+  // bits per input symbol of the last message
+  double average_length() {
+    return avglen;
+  }
+
+  std::string decode(const DynamicBitset &bset) {
+    if(bset.size() == 0) {
+      return "";
+    }
+    size_t at = 0;
+    auto get = [&]() -> uint64_t {
+      if(at + LENGTH_BITS > bset.size()) {
+        throw std::domain_error("truncated block sorting header");
+      }
+      const auto x = bset.get_bits(at, LENGTH_BITS);
+      at += LENGTH_BITS;
+      return x;
+    };
+    const auto count = get();
+    if(count > (bset.size() - at) / (3 * LENGTH_BITS)) {
+      throw std::domain_error("truncated block sorting header");
+    }
+    std::vector<BlockHeader> blocks(count);
+    uint64_t total = 0, stage_total = 0;
+    for(auto &b : blocks) {
+      b.length = get();
+      b.primary = get();
+      b.stage_length = get();
+      // a symbol adds at most one stage symbol
+      if(b.length == 0 || b.length > MAX_BLOCK_SIZE || b.primary > b.length || b.stage_length > b.length) {
+        throw std::domain_error("invalid block header");
+      }
+      total += b.length;
+      stage_total += b.stage_length;
+    }
+    Histogram hist;
+    for(size_t c = 0; c < stage_symbols(); ++c) {
+      hist.counts[c] = get();
+      hist.total += hist.counts[c];
+    }
+    if(hist.total != stage_total) {
+      throw std::domain_error("invalid block header");
+    }
+    const char eot = Arithmetic::END_OF_TEXT;
+    if(terminated) {
+      hist.add(&eot, 1);
+    }
+    auto stage_alphabet = hist.alphabet();
+    auto stage_probabilities = hist.probabilities(stage_alphabet);
+    const CodingMeta stage_meta(stage_alphabet, stage_probabilities);
+    Coder coder(stage_meta);
+    coder.trace = trace;
+    auto stage = coder.decode(bset.slice(at, bset.size() - at));
+    if(terminated) {
+      if(stage.empty() || stage.back() != eot) {
+        throw std::domain_error("unable to fully decode the text");
+      }
+      stage.pop_back();
+    }
+    if(stage.length() != stage_total) {
+      throw std::domain_error("unable to fully decode the text");
+    }
+    std::string s;
+    s.reserve(total);
+    size_t pos = 0;
+    for(auto &b : blocks) {
+      scratch.reset();
+      Trace::Timer mtf_timer(trace, "bwt.inverse_mtf");
+      const int32_t n = b.length;
+      const size_t end = pos + b.stage_length;
+      if(end > stage.length()) {
+        throw std::domain_error("unable to fully decode the text");
+      }
+      auto last = scratch.make_array<uint8_t>(n);
+      uint8_t order[256];
+      for(int c = 0; c < 256; ++c) {
+        order[c] = c;
+      }
+      int32_t i = 0;
+      while(pos < end) {
+        const int x = uint8_t(stage[pos]);
+        if(x == RUNA || x == RUNB) {
+          uint32_t run = 0;
+          for(uint32_t weight = 1; pos < end && uint8_t(stage[pos]) <= RUNB; weight <<= 1, ++pos) {
+            run += weight * (uint8_t(stage[pos]) + 1);
+          }
+          if(i + run > uint32_t(n)) {
+            throw std::domain_error("unable to fully decode the text");
+          }
+          std::fill(last + i, last + i + run, order[0]);
+          i += run;
+        } else {
+          const int j = x - 1;
+          const auto c = order[j];
+          std::memmove(order + 1, order, j);
+          order[0] = c;
+          if(i == n) {
+            throw std::domain_error("unable to fully decode the text");
+          }
+          last[i++] = c;
+          ++pos;
+        }
+      }
+      if(i != n) {
+        throw std::domain_error("unable to fully decode the text");
+      }
+      mtf_timer.stop();
+      Trace::Timer inverse_timer(trace, "bwt.inverse");
+      auto block = scratch.make_array<uint8_t>(n);
+      inverse(last, n, b.primary, block);
+      for(int32_t k = 0; k < n; ++k) {
+        s += meta.get_char(block[k]);
+      }
+    }
+    return s;
+  }
+};
+
+} // namespace coding
+
+#endif /* end of include guard: CODINGBWT_HPP */
@@ -15,13 +15,25 @@ struct Base {
     meta(meta)
   {}
 
-  DynamicBitset encode(const std::string &text) {
+  // bits of a message of n symbols at most
+  size_t max_encoded_size(size_t n) const noexcept {
+    return n * CHAR_BIT;
+  }
+
+  // into a reused buffer, returns the number of bits
+  size_t encode(const std::string &text, DynamicBitset &out) const {
+    out.clear();
+    out.append(text);
+    return out.size();
+  }
+
+  DynamicBitset encode(const std::string &text) const {
     DynamicBitset bset;
-    bset.append(text);
+    encode(text, bset);
     return bset;
   }
 
-  double average_length() {
+  double average_length() const {
     double avglen = 0.;
     for(int i = 0; i < meta.size(); ++i) {
       avglen += meta.get_prob(i) * 8;
@@ -29,12 +41,13 @@ struct Base {
     return avglen;
   }
 
-  std::string decode(const DynamicBitset &bset) {
+  // into a reused buffer, returns the number of symbols
+  size_t decode(const DynamicBitset &bset, std::string &s) const {
     if(bset.size() & 0x07) {
       throw std::runtime_error("the bitset size must divide 8");
     }
     auto len = bset.size() / CHAR_BIT;
-    std::string s;
+    s.clear();
     for(int i = 0; i < len; ++i) {
       unsigned char c = 0x00;
       for(int j = 0; j < CHAR_BIT; ++j) {
@@ -44,6 +57,12 @@ struct Base {
       }
       s += c;
     }
+    return s.length();
+  }
+
+  std::string decode(const DynamicBitset &bset) const {
+    std::string s;
+    decode(bset, s);
     return s;
   }
 };
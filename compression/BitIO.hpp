@@ -0,0 +1,94 @@
+#ifndef CODINGBITIO_HPP
+#define CODINGBITIO_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include <DynamicBitset.hpp>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace coding {
+
+// number of leading zero bits, 64 for zero
+inline int clz64(uint64_t x) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+  return x ? __builtin_clzll(x) : 64;
+#elif defined(_MSC_VER) && defined(_M_X64)
+  unsigned long i;
+  return _BitScanReverse64(&i, x) ? 63 - int(i) : 64;
+#else
+  int n = 0;
+  for(uint64_t bit = uint64_t(1) << 63; bit && !(x & bit); bit >>= 1) {
+    ++n;
+  }
+  return n;
+#endif
+}
+
+// appends the low n <= 64 bits of x, most significant first
+inline void put_bits(DynamicBitset &bset, uint64_t x, int n) {
+  for(int i = n - 1; i >= 0; --i) {
+    bset.append_bit((x >> i) & 1);
+  }
+}
+
+// zero words after a packed stream: any one value read from within the
+// stream, a universal code of up to 171 bits and the 64 bit window of its
+// last peek, ends inside them. callers check pos after each value
+constexpr int PACK_PADDING = 8;
+
+// reads a stream packed into words, most significant bit first
+struct BitReader {
+  const uint64_t *words;
+  size_t pos;
+
+  // the next n bits, 1 <= n <= 64; words past the stream are zero
+  uint64_t peek(int n) const noexcept {
+    const size_t i = pos >> 6;
+    const int off = pos & 63;
+    // shifting by 63 - off rather than 64 - off keeps off = 0 defined
+    const uint64_t w = (words[i] << off) | ((words[i + 1] >> 1) >> (63 - off));
+    return w >> (64 - n);
+  }
+
+  uint64_t read(int n) noexcept {
+    const auto x = peek(n);
+    pos += n;
+    return x;
+  }
+
+  // zeros before the next one, 64 if there is none in the next 64 bits
+  int leading_zeros() const noexcept {
+    return clz64(peek(64));
+  }
+};
+
+// n bits from pos, followed by zero words for the readers to run into;
+// returns where they start in words
+inline size_t pack_bits(const DynamicBitset &bset, size_t pos, size_t n, std::vector<uint64_t> &words) {
+  const size_t start = words.size();
+  auto it = bset.bitset_.begin() + pos;
+  for(; n >= 64; n -= 64) {
+    uint64_t w = 0;
+    for(int j = 0; j < 64; ++j, ++it) {
+      w = (w << 1) | uint64_t(*it);
+    }
+    words.push_back(w);
+  }
+  if(n > 0) {
+    uint64_t w = 0;
+    for(size_t j = 0; j < n; ++j, ++it) {
+      w = (w << 1) | uint64_t(*it);
+    }
+    words.push_back(w << (64 - n));
+  }
+  words.insert(words.end(), PACK_PADDING, 0);
+  return start;
+}
+
+} // namespace coding
+
+#endif /* end of include guard: CODINGBITIO_HPP */
@@ -4,41 +4,68 @@
 #include <climits>
 #include <cstdint>
 #include <iostream>
+#include <memory>
 
 #include <Base.hpp>
 
 namespace coding {
 
-struct Block {
+template <typename Sym>
+struct BasicBlock {
   using block_t = uint32_t;
+  using meta_type = BasicCodingMeta<Sym>;
+  using string_type = typename meta_type::string_type;
   static constexpr int MAX_BLOCK_SIZE_BITS = 5;
 
-  const CodingMeta &meta;
+  // keeps a shared model alive, meta refers to it
+  std::shared_ptr<const meta_type> shared_meta;
+  const meta_type &meta;
+  // fixed by the model, the codec is immutable after construction
   block_t block_size = 0x00;
 
-  Block(const CodingMeta &meta):
+  BasicBlock(const meta_type &meta):
     meta(meta)
-  {}
+  {
+    int n = meta.size();
+    while((1 << block_size) < n)++block_size;
+    if(n==1)block_size=1;
+  }
 
-  DynamicBitset encode(const std::string &text) {
+  BasicBlock(std::shared_ptr<const meta_type> meta):
+    BasicBlock(*meta)
+  {
+    shared_meta = std::move(meta);
+  }
+
+  // bits of a message of n symbols at most
+  size_t max_encoded_size(size_t n) const noexcept {
+    return n * block_size;
+  }
+
+  DynamicBitset encode(const string_type &text) const {
     DynamicBitset bset;
-    int n = meta.size();
-    int blqsize = 0;
-    while((1 << blqsize) < n)++blqsize;
-    if(n==1)blqsize=1;
+    encode(text, bset);
+    return bset;
+  }
+
+  // into a reused buffer, returns the number of bits
+  size_t encode(const string_type &text, DynamicBitset &bset) const {
+    bset.clear();
+    const int blqsize = block_size;
     // encode
-    for(char c : text) {
-      int pos = meta.find_char(c);
+    for(Sym c : text) {
+      const auto pos = meta.find_char(c);
+      if(pos == meta_type::npos) {
+        throw std::domain_error("symbol outside of the alphabet");
+      }
       for(int i = 0; i < blqsize; ++i) {
         bset.append_bit(pos & 1 << (blqsize - i - 1));
       }
     }
-    // set the attributes
-    block_size = blqsize;
-    return bset;
+    return bset.size();
   }
 
-  double average_length() {
+  double average_length() const {
     double avglen = 0.;
     for(int i = 0; i < meta.size(); ++i) {
       avglen += meta.get_prob(i) * block_size;
@@ -46,9 +73,16 @@ struct Block {
     return avglen;
   }
 
-  std::string decode(const DynamicBitset &bset) {
+  string_type decode(const DynamicBitset &bset) const {
+    string_type s;
+    decode(bset, s);
+    return s;
+  }
+
+  // into a reused buffer, returns the number of symbols
+  size_t decode(const DynamicBitset &bset, string_type &s) const {
     auto len = bset.size() / block_size;
-    std::string s;
+    s.clear();
     s.reserve(len);
     for(int i = 0; i < len; ++i) {
       int index = i * block_size;
@@ -56,12 +90,17 @@ struct Block {
       for(int j = 0; j < block_size; ++j) {
         pos += bset[index + j] << (block_size - j - 1);
       }
-      s += meta.get_char(pos);
+      if(pos >= meta.size()) {
+        throw std::domain_error("symbol outside of the alphabet");
+      }
+      s.push_back(meta.get_char(pos));
     }
-    return s;
+    return s.size();
   }
 };
 
+using Block = BasicBlock<char>;
+
 } // namespace coding
 
 #endif /* end of include guard: CODINGBLOCK_HPP */
@@ -0,0 +1,181 @@
+#ifndef CODINGCANONICAL_HPP
+#define CODINGCANONICAL_HPP
+
+#include <cstdint>
+#include <algorithm>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <DynamicBitset.hpp>
+
+namespace coding {
+
+// canonical huffman code over symbol indices: fully described by the code
+// lengths, so only those are stored; decoding is a single lookup of
+// max_length bits in a flat table
+struct CanonicalCode {
+  // a length field is 4 bits wide
+  static constexpr int MAX_LENGTH = 15;
+  // decoding table entries pack the symbol above the code length
+  static constexpr int LENGTH_BITS = 4;
+
+  // zero for symbols that do not occur
+  std::vector<uint8_t> lengths;
+  std::vector<uint32_t> codes;
+  std::vector<uint16_t> table;
+  int max_length = 0;
+
+  CanonicalCode() {}
+
+  explicit CanonicalCode(std::vector<uint8_t> code_lengths):
+    lengths(std::move(code_lengths))
+  {
+    assign_codes();
+  }
+
+  // huffman code lengths at most limit bits long: counts are flattened
+  // until the tree is shallow enough. a lone symbol gets one bit.
+  static std::vector<uint8_t> code_lengths(const uint64_t *counts, size_t n, int limit = MAX_LENGTH) {
+    std::vector<uint64_t> weight(counts, counts + n);
+    std::vector<uint8_t> lengths(n, 0);
+    while(1) {
+      using item = std::pair<uint64_t, int>;
+      std::priority_queue<item, std::vector<item>, std::greater<item>> heap;
+      std::vector<int> parent;
+      for(size_t i = 0; i < n; ++i) {
+        if(weight[i]) {
+          heap.emplace(weight[i], parent.size());
+          parent.push_back(-1);
+        }
+      }
+      if(parent.size() == 1) {
+        for(size_t i = 0; i < n; ++i) {
+          lengths[i] = weight[i] ? 1 : 0;
+        }
+        return lengths;
+      }
+      while(heap.size() > 1) {
+        auto x = heap.top(); heap.pop();
+        auto y = heap.top(); heap.pop();
+        parent[x.second] = parent[y.second] = parent.size();
+        heap.emplace(x.first + y.first, parent.size());
+        parent.push_back(-1);
+      }
+      // parents come after their children, depths in one backward pass
+      std::vector<uint8_t> depth(parent.size(), 0);
+      for(int k = int(parent.size()) - 2; k >= 0; --k) {
+        depth[k] = depth[parent[k]] + 1;
+      }
+      int deepest = 0;
+      for(size_t i = 0, k = 0; i < n; ++i) {
+        if(weight[i]) {
+          lengths[i] = depth[k++];
+          deepest = std::max<int>(deepest, lengths[i]);
+        }
+      }
+      if(deepest <= limit) {
+        return lengths;
+      }
+      for(auto &w : weight) {
+        if(w) {
+          w = (w >> 1) | 1;
+        }
+      }
+    }
+  }
+
+  // codes by length, then by symbol index
+  void assign_codes() {
+    max_length = 0;
+    for(auto l : lengths) {
+      if(l > MAX_LENGTH) {
+        throw std::domain_error("code length out of range");
+      }
+      max_length = std::max<int>(max_length, l);
+    }
+    codes.assign(lengths.size(), 0);
+    table.assign(size_t(1) << max_length, 0);
+    uint32_t code = 0;
+    for(int len = 1; len <= max_length; ++len) {
+      for(size_t i = 0; i < lengths.size(); ++i) {
+        if(lengths[i] == len) {
+          codes[i] = code++;
+          const int shift = max_length - len;
+          std::fill(table.begin() + (size_t(codes[i]) << shift), table.begin() + (size_t(codes[i] + 1) << shift),
+                    uint16_t((i << LENGTH_BITS) | len));
+        }
+      }
+      if(code > (uint32_t(1) << len)) {
+        throw std::domain_error("code lengths do not form a prefix code");
+      }
+      code <<= 1;
+    }
+  }
+
+  void encode(DynamicBitset &bset, size_t symbol) const {
+    const int len = lengths[symbol];
+    if(len == 0) {
+      throw std::domain_error("symbol has no code");
+    }
+    for(int i = len - 1; i >= 0; --i) {
+      bset.append_bit((codes[symbol] >> i) & 1);
+    }
+  }
+
+  // symbol index at pos, pos is advanced past its code
+  size_t decode(const DynamicBitset &bset, size_t &pos) const {
+    const auto entry = table[bset.get_bits(pos, max_length)];
+    const int len = entry & ((1 << LENGTH_BITS) - 1);
+    if(len == 0 || pos + len > bset.size()) {
+      throw std::domain_error("unable to fully decode the text");
+    }
+    pos += len;
+    return entry >> LENGTH_BITS;
+  }
+
+  // lengths as steps from the previous one: 1 and a direction bit per
+  // step, 0 to take the current length. similar lengths cost ~1 bit each.
+  void write(DynamicBitset &bset) const {
+    int cur = lengths.empty() ? 0 : lengths[0];
+    for(int i = LENGTH_BITS - 1; i >= 0; --i) {
+      bset.append_bit((cur >> i) & 1);
+    }
+    for(auto l : lengths) {
+      for(; cur != l; cur += (l > cur) ? 1 : -1) {
+        bset.append_bit(1);
+        bset.append_bit(l < cur);
+      }
+      bset.append_bit(0);
+    }
+  }
+
+  static CanonicalCode read(const DynamicBitset &bset, size_t &pos, size_t n) {
+    auto bit = [&]() {
+      if(pos >= bset.size()) {
+        throw std::domain_error("truncated code lengths");
+      }
+      return bool(bset[pos++]);
+    };
+    int cur = 0;
+    for(int i = 0; i < LENGTH_BITS; ++i) {
+      cur = (cur << 1) | bit();
+    }
+    std::vector<uint8_t> lengths(n);
+    for(size_t i = 0; i < n; ++i) {
+      while(bit()) {
+        cur += bit() ? -1 : 1;
+        if(cur < 0 || cur > MAX_LENGTH) {
+          throw std::domain_error("code length out of range");
+        }
+      }
+      lengths[i] = cur;
+    }
+    return CanonicalCode(std::move(lengths));
+  }
+};
+
+} // namespace coding
+
+#endif /* end of include guard: CODINGCANONICAL_HPP */
@@ -0,0 +1,108 @@
+#ifndef CODINGCHECKED_HPP
+#define CODINGCHECKED_HPP
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <Base.hpp>
+#include <Hash.hpp>
+#include <Huffman.hpp>
+#include <Trace.hpp>
+
+namespace coding {
+
+// a frame of Coder's code followed by the xxh64 of the message, so that
+// damage is reported as such instead of as whatever the coder makes of
+// it: an exception from deep inside, or for Block and LZ77 a wrong text.
+// the hash is taken as the text streams through encode_more, so an
+// Incremental<Checked<Coder>> keeps it up to date at no extra pass.
+//
+// layout: the code, then the checksum in CHECKSUM_BITS.
+template <typename Coder = Huffman>
+struct Checked {
+  static constexpr int CHECKSUM_BITS = 64;
+
+  Coder coder;
+  // the hash of the message encoded by begin and encode_more
+  XXHash64 hash_;
+  // optional instrumentation, handed on to the coder
+  Trace *trace = nullptr;
+
+  template <typename... Args>
+  explicit Checked(Args &&...args):
+    coder(std::forward<Args>(args)...)
+  {}
+
+  static void put(DynamicBitset &bset, uint64_t x, int bits) {
+    for(int i = bits - 1; i >= 0; --i) {
+      bset.append_bit((x >> i) & 1);
+    }
+  }
+
+  // bits of a message of n symbols at most
+  size_t max_encoded_size(size_t n) const noexcept {
+    return coder.max_encoded_size(n) + CHECKSUM_BITS;
+  }
+
+  void begin() {
+    attach_trace(coder, trace);
+    coder.begin();
+    hash_.reset();
+  }
+
+  void encode_more(const std::string &text, DynamicBitset &bset) {
+    attach_trace(coder, trace);
+    coder.encode_more(text, bset);
+    hash_.update(text);
+  }
+
+  void finish(DynamicBitset &bset) const {
+    coder.finish(bset);
+    put(bset, hash_.digest(), CHECKSUM_BITS);
+  }
+
+  DynamicBitset encode(const std::string &text) {
+    attach_trace(coder, trace);
+    auto bset = coder.encode(text);
+    Trace::Timer timer(trace, "checked.hash");
+    put(bset, xxhash64(text), CHECKSUM_BITS);
+    return bset;
+  }
+
+  // for coders that rewrite their codes, see Incremental
+  template <typename C = Coder>
+  auto code_width() const noexcept -> decltype(std::declval<const C &>().code_width()) {
+    return coder.code_width();
+  }
+
+  double average_length() {
+    return coder.average_length();
+  }
+
+  // the code is sliced off the checksum for the coder
+  std::string decode(const DynamicBitset &bset) {
+    if(bset.size() < CHECKSUM_BITS) {
+      throw std::domain_error("truncated checksum");
+    }
+    attach_trace(coder, trace);
+    const size_t n = bset.size() - CHECKSUM_BITS;
+    std::string s;
+    try {
+      s = coder.decode(bset.slice(0, n));
+    } catch(const std::exception &e) {
+      // the coder choked on the damage the checksum is there to report
+      throw std::domain_error(std::string("corrupt frame: ") + e.what());
+    }
+    Trace::Timer timer(trace, "checked.hash");
+    if(xxhash64(s) != bset.get_bits(n, CHECKSUM_BITS)) {
+      throw std::domain_error("checksum mismatch");
+    }
+    return s;
+  }
+};
+
+} // namespace coding
+
+#endif /* end of include guard: CODINGCHECKED_HPP */
@@ -4,9 +4,31 @@
 #include <Base.hpp>
 #include <Block.hpp>
 #include <Huffman.hpp>
+#include <StaticHuffman.hpp>
+#include <ContextHuffman.hpp>
+#include <AdaptiveHuffman.hpp>
 #include <Arithmetic.hpp>
 #include <Shannon.hpp>
 #include <LZ77.hpp>
 #include <LZW.hpp>
+#include <Histogram.hpp>
+#include <Dictionary.hpp>
+#include <BWT.hpp>
+#include <Auto.hpp>
+#include <LongRange.hpp>
+#include <Seekable.hpp>
+#include <Search.hpp>
+#include <Interleaved.hpp>
+#include <Tunstall.hpp>
+#include <BitIO.hpp>
+#include <Universal.hpp>
+#include <RunLength.hpp>
+#include <Model.hpp>
+#include <ModelCache.hpp>
+#include <Hash.hpp>
+#include <Checked.hpp>
+#include <Pipeline.hpp>
+#include <Incremental.hpp>
+#include <Trace.hpp>
 
 #endif /* end of include guard: CODING_HPP */
@@ -2,22 +2,78 @@
 #define CODINGMETA_HPP
 
 #include <cmath>
+#include <algorithm>
+#include <array>
 #include <stdexcept>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <DynamicBitset.hpp>
 
 namespace coding {
 
-class CodingMeta {
-  std::string alphabet_;
+namespace detail {
+
+// bytes keep using strings, wider symbols are stored in vectors
+template <typename Sym> struct symbol_string { using type = std::vector<Sym>; };
+template <> struct symbol_string<char> { using type = std::string; };
+
+// position of a symbol in the alphabet: binary search over the sorted
+// alphabet, so a sparse model only pays for the symbols it has
+template <typename Sym>
+class symbol_index {
+  std::vector<std::pair<Sym, size_t>> sorted_;
+public:
+  template <typename Alphabet>
+  explicit symbol_index(const Alphabet &alphabet) {
+    sorted_.reserve(alphabet.size());
+    for(size_t i = 0; i < alphabet.size(); ++i) {
+      sorted_.emplace_back(alphabet[i], i);
+    }
+    std::sort(sorted_.begin(), sorted_.end());
+  }
+
+  size_t find(Sym c) const noexcept {
+    auto it = std::lower_bound(sorted_.begin(), sorted_.end(), std::make_pair(c, size_t(0)));
+    return (it != sorted_.end() && it->first == c) ? it->second : size_t(-1);
+  }
+};
+
+// bytes are looked up directly
+template <>
+class symbol_index<char> {
+  std::array<size_t, 256> table_;
+public:
+  explicit symbol_index(const std::string &alphabet) {
+    table_.fill(size_t(-1));
+    for(size_t i = alphabet.length(); i > 0; --i) {
+      table_[uint8_t(alphabet[i - 1])] = i - 1;
+    }
+  }
+
+  size_t find(char c) const noexcept {
+    return table_[uint8_t(c)];
+  }
+};
+
+} // namespace detail
+
+template <typename Sym>
+class BasicCodingMeta {
+ public:
+  using symbol_type = Sym;
+  using string_type = typename detail::symbol_string<Sym>::type;
+  static constexpr size_t npos = size_t(-1);
+ private:
+  string_type alphabet_;
   std::vector <float> probabilities_;
+  detail::symbol_index<Sym> index_;
  public:
-  CodingMeta(std::string &alphabet, std::vector <float> &probabilities):
-    alphabet_(alphabet), probabilities_(probabilities)
+  BasicCodingMeta(string_type &alphabet, std::vector <float> &probabilities):
+    alphabet_(alphabet), probabilities_(probabilities), index_(alphabet_)
   {
-    if(alphabet.length() != probabilities.size()) {
+    if(alphabet.size() != probabilities.size()) {
       throw std::runtime_error("alphabet length must match the number of probabilities");
     }
     auto sum = .0f;
@@ -31,14 +87,20 @@ class CodingMeta {
       p /= 1.f/sum;
     }
   }
-  const std::string &alphabet() const { return alphabet_; }
+  const string_type &alphabet() const { return alphabet_; }
   const std::vector<float> &probabilities() const { return probabilities_; }
-  size_t size() const { return alphabet_.length(); }
-  char get_char(size_t i) const { return alphabet_[i]; }
-  size_t find_char(char c) const { return alphabet_.find(c); }
+  size_t size() const { return alphabet_.size(); }
+  Sym get_char(size_t i) const { return alphabet_[i]; }
+  // npos if the symbol is not in the alphabet
+  size_t find_char(Sym c) const { return index_.find(c); }
   float get_prob(size_t i) const { return probabilities_[i]; }
 };
 
+template <typename Sym>
+constexpr size_t BasicCodingMeta<Sym>::npos;
+
+using CodingMeta = BasicCodingMeta<char>;
+
 } // namespace coding
 
 
@@ -29,20 +29,48 @@ DEFINES += QT_DEPRECATED_WARNINGS
 
 SOURCES += \
         main.cpp \
-        mainwindow.cpp
+        mainwindow.cpp \
+        encodingworker.cpp \
+        bitstreamview.cpp
 
 HEADERS += \
         mainwindow.h \
+        encodingworker.h \
+        bitstreamview.h \
         Coding.hpp \
         CodingMeta.hpp \
         DynamicBitset.hpp \
         Base.hpp \
         Block.hpp \
         Huffman.hpp \
+        StaticHuffman.hpp \
+        Canonical.hpp \
+        ContextHuffman.hpp \
+        AdaptiveHuffman.hpp \
         Arithmetic.hpp \
         Shannon.hpp \
         LZ77.hpp \
-        LZW.hpp
+        LZW.hpp \
+        Histogram.hpp \
+        Arena.hpp \
+        Dictionary.hpp \
+        BWT.hpp \
+        Auto.hpp \
+        LongRange.hpp \
+        Seekable.hpp \
+        Search.hpp \
+        Interleaved.hpp \
+        Tunstall.hpp \
+        BitIO.hpp \
+        Universal.hpp \
+        RunLength.hpp \
+        Model.hpp \
+        ModelCache.hpp \
+        Hash.hpp \
+        Checked.hpp \
+        Pipeline.hpp \
+        Incremental.hpp \
+        Trace.hpp
 
 FORMS += \
         mainwindow.ui
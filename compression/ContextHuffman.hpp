@@ -0,0 +1,173 @@
+#ifndef CODINGCONTEXTHUFFMAN_HPP
+#define CODINGCONTEXTHUFFMAN_HPP
+
+#include <cstdint>
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <Base.hpp>
+#include <Canonical.hpp>
+#include <Trace.hpp>
+
+namespace coding {
+
+// order-1 huffman: every symbol is coded with a table chosen by the symbol
+// before it. the tables are fitted to the message and stored in front of
+// it, so contexts that are too rare to pay for a table of their own share
+// the order-0 one.
+//
+// layout: one bit per context (a table of its own or not), the order-0
+// table, then the tables of the contexts that have one, then the codes
+struct ContextHuffman {
+  // short codes keep every context's decoding table small
+  static constexpr int MAX_LENGTH = 11;
+  // a context needs this many symbols to get a table
+  static constexpr uint64_t MIN_CONTEXT_COUNT = 64;
+
+  // keeps a shared model alive, meta refers to it
+  std::shared_ptr<const CodingMeta> shared_meta;
+  const CodingMeta &meta;
+  // tables of the last encoded message, decode reads its own. contexts
+  // are alphabet indices, the first symbol has its own context
+  std::vector<CanonicalCode> tables;
+  std::vector<int> table_of;
+  double avglen = 0.;
+  // optional instrumentation
+  Trace *trace = nullptr;
+
+  ContextHuffman(const CodingMeta &meta):
+    meta(meta)
+  {}
+
+  ContextHuffman(std::shared_ptr<const CodingMeta> meta):
+    ContextHuffman(*meta)
+  {
+    shared_meta = std::move(meta);
+  }
+
+  size_t start_context() const noexcept {
+    return meta.size();
+  }
+
+  std::vector<int16_t> symbol_indices() const {
+    std::vector<int16_t> index(256, -1);
+    for(size_t i = 0; i < meta.size(); ++i) {
+      index[uint8_t(meta.get_char(i))] = i;
+    }
+    return index;
+  }
+
+  // fit the tables to the text, cost of a table included
+  void build_tables(const std::vector<uint16_t> &symbols) {
+    const size_t n = meta.size(), contexts = n + 1;
+    std::vector<uint64_t> counts(contexts * n, 0), order0(n, 0);
+    for(size_t i = 0, ctx = start_context(); i < symbols.size(); ctx = symbols[i++]) {
+      ++counts[ctx * n + symbols[i]];
+      ++order0[symbols[i]];
+    }
+    tables.clear();
+    tables.emplace_back(CanonicalCode::code_lengths(order0.data(), n, MAX_LENGTH));
+    table_of.assign(contexts, 0);
+    auto cost = [&](const CanonicalCode &code, const uint64_t *c) {
+      uint64_t bits = 0;
+      for(size_t s = 0; s < n; ++s) {
+        bits += c[s] * code.lengths[s];
+      }
+      return bits;
+    };
+    for(size_t ctx = 0; ctx < contexts; ++ctx) {
+      const uint64_t *c = counts.data() + ctx * n;
+      uint64_t total = 0;
+      for(size_t s = 0; s < n; ++s) {
+        total += c[s];
+      }
+      if(total < MIN_CONTEXT_COUNT) {
+        continue;
+      }
+      CanonicalCode code(CanonicalCode::code_lengths(c, n, MAX_LENGTH));
+      DynamicBitset header;
+      code.write(header);
+      if(cost(code, c) + header.size() < cost(tables[0], c)) {
+        table_of[ctx] = tables.size();
+        tables.push_back(std::move(code));
+      }
+    }
+  }
+
+  DynamicBitset encode(const std::string &text) {
+    DynamicBitset bset;
+    const auto index = symbol_indices();
+    std::vector<uint16_t> symbols(text.length());
+    for(size_t i = 0; i < text.length(); ++i) {
+      const auto x = index[uint8_t(text[i])];
+      if(x < 0) {
+        throw std::domain_error("symbol outside of the alphabet");
+      }
+      symbols[i] = x;
+    }
+    Trace::Timer build_timer(trace, "context_huffman.build");
+    build_tables(symbols);
+    build_timer.stop();
+    Trace::Timer encode_timer(trace, "context_huffman.encode");
+    if(trace) {
+      trace->count("context_huffman.tables", tables.size());
+    }
+    for(size_t ctx = 0; ctx < table_of.size(); ++ctx) {
+      bset.append_bit(table_of[ctx] != 0);
+    }
+    for(auto &t : tables) {
+      t.write(bset);
+    }
+    for(size_t i = 0, ctx = start_context(); i < symbols.size(); ctx = symbols[i++]) {
+      tables[table_of[ctx]].encode(bset, symbols[i]);
+    }
+    avglen = text.empty() ? 0. : double(bset.size()) / text.length();
+    return bset;
+  }
+
+  // bits per symbol of the last message, tables included
+  double average_length() {
+    return avglen;
+  }
+
+  std::string decode(const DynamicBitset &bset) const {
+    Trace::Timer timer(trace, "context_huffman.decode");
+    const size_t n = meta.size(), contexts = n + 1;
+    if(bset.size() < contexts) {
+      throw std::domain_error("truncated context tables");
+    }
+    size_t pos = 0;
+    std::vector<bool> own(contexts);
+    for(size_t ctx = 0; ctx < contexts; ++ctx) {
+      own[ctx] = bset[pos++];
+    }
+    // kept apart from the tables of the last encoded message
+    std::vector<CanonicalCode> codes;
+    codes.push_back(CanonicalCode::read(bset, pos, n));
+    for(size_t ctx = 0; ctx < contexts; ++ctx) {
+      if(own[ctx]) {
+        codes.push_back(CanonicalCode::read(bset, pos, n));
+      }
+    }
+    // one lookup table per context
+    std::vector<const CanonicalCode *> code(contexts);
+    for(size_t ctx = 0, k = 1; ctx < contexts; ++ctx) {
+      code[ctx] = &codes[own[ctx] ? k++ : 0];
+    }
+    std::string s;
+    for(size_t ctx = start_context(); pos < bset.size();) {
+      ctx = code[ctx]->decode(bset, pos);
+      if(ctx >= n) {
+        throw std::domain_error("unable to fully decode the text");
+      }
+      s += meta.get_char(ctx);
+    }
+    return s;
+  }
+};
+
+} // namespace coding
+
+#endif /* end of include guard: CODINGCONTEXTHUFFMAN_HPP */
@@ -0,0 +1,319 @@
+#ifndef CODINGDICTIONARY_HPP
+#define CODINGDICTIONARY_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace coding {
+
+// chains of earlier positions that share the hash of their first bytes
+struct HashChain {
+  static constexpr int HASH_BITS = 12;
+  static constexpr int MIN_MATCH = 3;
+
+  static uint32_t hash(const char *p) noexcept {
+    uint32_t x = uint32_t(uint8_t(p[0])) << 16 | uint32_t(uint8_t(p[1])) << 8 | uint8_t(p[2]);
+    return (x * 2654435761u) >> (32 - HASH_BITS);
+  }
+
+  std::vector<int32_t> head;
+  std::vector<int32_t> prev;
+
+  HashChain() {}
+
+  explicit HashChain(const std::string &s):
+    head(1 << HASH_BITS, -1), prev(s.length(), -1)
+  {
+    for(int32_t pos = 0; pos + MIN_MATCH <= int32_t(s.length()); ++pos) {
+      auto h = hash(s.data() + pos);
+      prev[pos] = head[h];
+      head[h] = pos;
+    }
+  }
+};
+
+// LZW phrases: (code, symbol) -> code of the phrase extended by the symbol,
+// open addressing over caller-provided storage
+struct PhraseTable {
+  uint64_t *keys = nullptr;
+  uint64_t *values = nullptr;
+  size_t mask = 0;
+
+  static size_t capacity_for(size_t n) noexcept {
+    size_t cap = 16;
+    while(cap < n * 2) cap <<= 1;
+    return cap;
+  }
+
+  // keys must be zeroed, capacity a power of two
+  void init(uint64_t *k, uint64_t *v, size_t capacity) noexcept {
+    keys = k, values = v, mask = capacity - 1;
+  }
+
+  size_t capacity() const noexcept {
+    return mask + 1;
+  }
+
+  static uint64_t key(uint64_t code, unsigned char c) noexcept {
+    return ((code << 8) | c) + 1;
+  }
+
+  size_t slot(uint64_t k) const noexcept {
+    return size_t((k * 0x9E3779B97F4A7C15ull) >> 24) & mask;
+  }
+
+  bool find(uint64_t code, unsigned char c, uint64_t &value) const noexcept {
+    const auto k = key(code, c);
+    for(size_t i = slot(k);; i = (i + 1) & mask) {
+      if(keys[i] == k) {
+        value = values[i];
+        return true;
+      } else if(keys[i] == 0) {
+        return false;
+      }
+    }
+  }
+
+  void insert(uint64_t code, unsigned char c, uint64_t value) noexcept {
+    const auto k = key(code, c);
+    size_t i = slot(k);
+    while(keys[i] != 0 && keys[i] != k) {
+      i = (i + 1) & mask;
+    }
+    keys[i] = k, values[i] = value;
+  }
+};
+
+// LZW phrase, stored as its prefix code plus one symbol
+struct Phrase {
+  uint64_t prefix;
+  size_t length;
+  char first;
+  char last;
+};
+
+// preset dictionary for many small, similar messages. the content is
+// placed in front of every message: LZ77 finds matches into it and LZW
+// starts with the phrases it would have learned from it. everything is
+// computed on construction, afterwards a dictionary is immutable and one
+// instance can be shared by any number of coders and threads.
+class Dictionary {
+  std::string alphabet_;
+  std::string content_;
+  HashChain chain_;
+  std::vector<uint64_t> lzw_keys_;
+  std::vector<uint64_t> lzw_values_;
+  PhraseTable lzw_table_;
+  std::vector<Phrase> lzw_phrases_;
+
+  static constexpr const char *MAGIC = "LZDC";
+  static constexpr uint8_t VERSION = 1;
+
+  static void write_u32(std::string &s, uint32_t x) {
+    for(int i = 0; i < 4; ++i) {
+      s += char(x >> (8 * i));
+    }
+  }
+
+  static uint32_t read_u32(const std::string &s, size_t &pos) {
+    if(pos + 4 > s.length()) {
+      throw std::runtime_error("truncated dictionary");
+    }
+    uint32_t x = 0;
+    for(int i = 0; i < 4; ++i) {
+      x |= uint32_t(uint8_t(s[pos++])) << (8 * i);
+    }
+    return x;
+  }
+
+  // run LZW over the content without emitting anything
+  void prime_lzw() {
+    std::vector<int64_t> symbol_code(256, -1);
+    for(size_t i = 0; i < alphabet_.length(); ++i) {
+      symbol_code[uint8_t(alphabet_[i])] = i;
+      lzw_phrases_.push_back(Phrase{0, 1, alphabet_[i], alphabet_[i]});
+    }
+    const size_t cap = PhraseTable::capacity_for(content_.length() + 1);
+    lzw_keys_.assign(cap, 0);
+    lzw_values_.assign(cap, 0);
+    lzw_table_.init(lzw_keys_.data(), lzw_values_.data(), cap);
+    bool has_w = false;
+    uint64_t w = 0;
+    for(auto c : content_) {
+      const auto code = symbol_code[uint8_t(c)];
+      if(code < 0) {
+        throw std::domain_error("dictionary symbol outside of the alphabet");
+      }
+      uint64_t x;
+      if(!has_w) {
+        w = code, has_w = true;
+      } else if(lzw_table_.find(w, c, x)) {
+        w = x;
+      } else {
+        const auto &p = lzw_phrases_[w];
+        lzw_table_.insert(w, c, lzw_phrases_.size());
+        lzw_phrases_.push_back(Phrase{w, p.length + 1, p.first, c});
+        w = code;
+      }
+    }
+  }
+
+public:
+  static constexpr size_t DEFAULT_SIZE = 4096;
+
+  Dictionary(std::string alphabet, std::string content):
+    alphabet_(std::move(alphabet)),
+    content_(std::move(content)),
+    chain_(content_)
+  {
+    prime_lzw();
+  }
+
+  Dictionary(const Dictionary &) = delete;
+  Dictionary &operator=(const Dictionary &) = delete;
+  Dictionary(Dictionary &&) = default;
+  Dictionary &operator=(Dictionary &&) = default;
+
+  const std::string &alphabet() const noexcept { return alphabet_; }
+  const std::string &content() const noexcept { return content_; }
+  size_t size() const noexcept { return content_.length(); }
+  const HashChain &chain() const noexcept { return chain_; }
+  // number of LZW codes in use before the first message symbol
+  uint64_t lzw_size() const noexcept { return lzw_phrases_.size(); }
+  const PhraseTable &lzw_table() const noexcept { return lzw_table_; }
+  const Phrase *lzw_phrases() const noexcept { return lzw_phrases_.data(); }
+
+  // magic, version, alphabet and content with 32-bit little-endian lengths
+  std::string serialize() const {
+    std::string s(MAGIC, MAGIC + 4);
+    s += char(VERSION);
+    write_u32(s, alphabet_.length());
+    s += alphabet_;
+    write_u32(s, content_.length());
+    s += content_;
+    return s;
+  }
+
+  static Dictionary deserialize(const std::string &s) {
+    if(s.length() < 5 || !std::equal(MAGIC, MAGIC + 4, s.begin())) {
+      throw std::runtime_error("not a dictionary");
+    }
+    if(uint8_t(s[4]) != VERSION) {
+      throw std::runtime_error("unsupported dictionary version " + std::to_string(int(uint8_t(s[4]))));
+    }
+    size_t pos = 5;
+    auto alen = read_u32(s, pos);
+    if(pos + alen > s.length()) {
+      throw std::runtime_error("truncated dictionary");
+    }
+    auto alphabet = s.substr(pos, alen);
+    pos += alen;
+    auto clen = read_u32(s, pos);
+    if(pos + clen > s.length()) {
+      throw std::runtime_error("truncated dictionary");
+    }
+    return Dictionary(alphabet, s.substr(pos, clen));
+  }
+
+  // greedy cover of the samples: segments are scored by how many samples
+  // share their k-mers, each k-mer counts once. the best segments are
+  // placed last, closest to the message, where references are shortest.
+  static Dictionary train(const std::vector<std::string> &samples, std::string alphabet, size_t max_size = DEFAULT_SIZE) {
+    constexpr int K = 6;
+    constexpr int SEGMENT = 32;
+    std::vector<bool> allowed(256, false);
+    for(auto c : alphabet) {
+      allowed[uint8_t(c)] = true;
+    }
+    auto kmer = [](const char *p) {
+      uint64_t x = 0;
+      std::memcpy(&x, p, K);
+      return x;
+    };
+    // in how many samples every k-mer occurs
+    std::unordered_map<uint64_t, uint32_t> freq;
+    for(auto &s : samples) {
+      std::unordered_set<uint64_t> seen;
+      for(size_t i = 0; i + K <= s.length(); ++i) {
+        seen.insert(kmer(s.data() + i));
+      }
+      for(auto x : seen) {
+        ++freq[x];
+      }
+    }
+    struct Candidate {
+      uint64_t score;
+      size_t sample, pos, len;
+      bool operator<(const Candidate &other) const { return score < other.score; }
+    };
+    auto score = [&](const Candidate &c) {
+      uint64_t total = 0;
+      const auto &s = samples[c.sample];
+      for(size_t i = c.pos; i + K <= c.pos + c.len; ++i) {
+        auto it = freq.find(kmer(s.data() + i));
+        // k-mers seen in a single sample do not generalize
+        if(it != freq.end() && it->second > 1) {
+          total += it->second;
+        }
+      }
+      return total;
+    };
+    std::priority_queue<Candidate> queue;
+    for(size_t k = 0; k < samples.size(); ++k) {
+      const auto &s = samples[k];
+      for(size_t pos = 0; pos + K <= s.length(); pos += SEGMENT / 2) {
+        Candidate c{0, k, pos, std::min<size_t>(SEGMENT, s.length() - pos)};
+        bool valid = true;
+        for(size_t i = c.pos; i < c.pos + c.len; ++i) {
+          valid = valid && allowed[uint8_t(s[i])];
+        }
+        if(valid) {
+          c.score = score(c);
+          queue.push(c);
+        }
+      }
+    }
+    // lazy greedy: scores only ever go down, so a candidate whose fresh
+    // score still beats the next best one is the best one
+    std::vector<std::string> segments;
+    size_t total = 0;
+    while(!queue.empty() && total < max_size) {
+      auto c = queue.top();
+      queue.pop();
+      auto fresh = score(c);
+      if(fresh == 0) {
+        continue;
+      }
+      if(!queue.empty() && fresh < queue.top().score) {
+        c.score = fresh;
+        queue.push(c);
+        continue;
+      }
+      auto len = std::min(c.len, max_size - total);
+      const auto &s = samples[c.sample];
+      segments.push_back(s.substr(c.pos, len));
+      total += len;
+      for(size_t i = c.pos; i + K <= c.pos + c.len; ++i) {
+        freq.erase(kmer(s.data() + i));
+      }
+    }
+    std::string content;
+    content.reserve(total);
+    for(auto it = segments.rbegin(); it != segments.rend(); ++it) {
+      content += *it;
+    }
+    return Dictionary(std::move(alphabet), std::move(content));
+  }
+};
+
+} // namespace coding
+
+#endif /* end of include guard: CODINGDICTIONARY_HPP */
@@ -3,6 +3,7 @@
 
 #include <cmath>
 #include <climits>
+#include <cstdint>
 #include <vector>
 #include <string>
 #include <bitset>
@@ -44,6 +45,13 @@ struct DynamicBitset {
   void pop() {
     bitset_.pop_back();
   }
+  // both keep the capacity, a reused bitset stops allocating
+  void clear() noexcept {
+    bitset_.clear();
+  }
+  void reserve(size_t n) {
+    bitset_.reserve(n);
+  }
   void reverse() {
     auto &self = *this;
     for(int i = 0; i < size() >> 1; ++i) {
@@ -52,6 +60,23 @@ struct DynamicBitset {
       self[size() - i - 1] = t;
     }
   }
+  // n <= 64 bits starting at pos, first bit most significant; zeros past the end
+  uint64_t get_bits(size_t pos, int n) const noexcept {
+    uint64_t x = 0;
+    for(int i = 0; i < n; ++i) {
+      x <<= 1;
+      if(pos + i < size() && bitset_[pos + i]) {
+        x |= 1;
+      }
+    }
+    return x;
+  }
+  // copy of n bits starting at pos
+  DynamicBitset slice(size_t pos, size_t n) const {
+    DynamicBitset bset;
+    bset.bitset_.assign(bitset_.begin() + pos, bitset_.begin() + pos + n);
+    return bset;
+  }
   std::string str() const noexcept {
     std::string s;
     s.reserve(size());
@@ -112,13 +137,15 @@ template <typename T> struct bit_appender<T, false> {
 };
 
 template <> struct bit_appender<DynamicBitset> {
-  static void append(DynamicBitset &bset, DynamicBitset &other) noexcept {
+  static void append(DynamicBitset &bset, const DynamicBitset &other) noexcept {
     for(size_t i = 0; i < other.size(); ++i) {
       bset.append_bit(other[i]);
     }
   }
 };
 
+template <> struct bit_appender<const DynamicBitset> : bit_appender<DynamicBitset> {};
+
 template <size_t N> struct bit_appender<std::bitset<N>, false> {
   static void append(DynamicBitset &bset, std::bitset<N> &other) noexcept {
     for(size_t i = 0; i < other.size(); ++i) {
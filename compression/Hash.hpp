@@ -0,0 +1,152 @@
+#ifndef CODINGHASH_HPP
+#define CODINGHASH_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace coding {
+
+// xxh64, streaming: four lanes of multiply and rotate over 32-byte
+// stripes keep a core busy at about memory bandwidth. not cryptographic,
+// it catches damage, not tampering. equal to the reference xxh64 for any
+// split of the input into updates.
+class XXHash64 {
+  static constexpr uint64_t P1 = 0x9E3779B185EBCA87ull;
+  static constexpr uint64_t P2 = 0xC2B2AE3D27D4EB4Full;
+  static constexpr uint64_t P3 = 0x165667B19E3779F9ull;
+  static constexpr uint64_t P4 = 0x85EBCA77C2B2AE63ull;
+  static constexpr uint64_t P5 = 0x27D4EB2F165667C5ull;
+
+  uint64_t seed_;
+  uint64_t v_[4];
+  uint64_t total_;
+  // the last partial stripe
+  uint8_t buffer_[32];
+  size_t buffered_;
+
+  static uint64_t rotl(uint64_t x, int r) noexcept {
+    return (x << r) | (x >> (64 - r));
+  }
+
+  // little endian whatever the host
+  static uint64_t read64(const uint8_t *p) noexcept {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    uint64_t x = 0;
+    for(int i = 7; i >= 0; --i) {
+      x = (x << 8) | p[i];
+    }
+    return x;
+#else
+    uint64_t x;
+    std::memcpy(&x, p, sizeof(x));
+    return x;
+#endif
+  }
+
+  static uint64_t read32(const uint8_t *p) noexcept {
+    return uint64_t(p[0]) | uint64_t(p[1]) << 8 | uint64_t(p[2]) << 16 | uint64_t(p[3]) << 24;
+  }
+
+  static uint64_t round(uint64_t acc, uint64_t input) noexcept {
+    return rotl(acc + input * P2, 31) * P1;
+  }
+
+  static uint64_t merge(uint64_t h, uint64_t v) noexcept {
+    return (h ^ round(0, v)) * P1 + P4;
+  }
+
+  void stripe(const uint8_t *p) noexcept {
+    v_[0] = round(v_[0], read64(p));
+    v_[1] = round(v_[1], read64(p + 8));
+    v_[2] = round(v_[2], read64(p + 16));
+    v_[3] = round(v_[3], read64(p + 24));
+  }
+
+public:
+  explicit XXHash64(uint64_t seed = 0) noexcept {
+    reset(seed);
+  }
+
+  void reset(uint64_t seed = 0) noexcept {
+    seed_ = seed;
+    v_[0] = seed + P1 + P2;
+    v_[1] = seed + P2;
+    v_[2] = seed;
+    v_[3] = seed - P1;
+    total_ = 0;
+    buffered_ = 0;
+  }
+
+  void update(const void *data, size_t n) noexcept {
+    auto p = static_cast<const uint8_t *>(data);
+    total_ += n;
+    if(buffered_ + n < 32) {
+      std::memcpy(buffer_ + buffered_, p, n);
+      buffered_ += n;
+      return;
+    }
+    if(buffered_ > 0) {
+      const size_t fill = 32 - buffered_;
+      std::memcpy(buffer_ + buffered_, p, fill);
+      stripe(buffer_);
+      p += fill, n -= fill;
+      buffered_ = 0;
+    }
+    for(; n >= 32; p += 32, n -= 32) {
+      stripe(p);
+    }
+    std::memcpy(buffer_, p, n);
+    buffered_ = n;
+  }
+
+  void update(const std::string &s) noexcept {
+    update(s.data(), s.size());
+  }
+
+  // of everything so far, more may follow
+  uint64_t digest() const noexcept {
+    uint64_t h;
+    if(total_ >= 32) {
+      h = rotl(v_[0], 1) + rotl(v_[1], 7) + rotl(v_[2], 12) + rotl(v_[3], 18);
+      for(int i = 0; i < 4; ++i) {
+        h = merge(h, v_[i]);
+      }
+    } else {
+      h = seed_ + P5;
+    }
+    h += total_;
+    const uint8_t *p = buffer_;
+    size_t n = buffered_;
+    for(; n >= 8; p += 8, n -= 8) {
+      h = rotl(h ^ round(0, read64(p)), 27) * P1 + P4;
+    }
+    if(n >= 4) {
+      h = rotl(h ^ (read32(p) * P1), 23) * P2 + P3;
+      p += 4, n -= 4;
+    }
+    for(; n > 0; ++p, --n) {
+      h = rotl(h ^ (*p * P5), 11) * P1;
+    }
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+  }
+};
+
+inline uint64_t xxhash64(const void *data, size_t n, uint64_t seed = 0) noexcept {
+  XXHash64 h(seed);
+  h.update(data, n);
+  return h.digest();
+}
+
+inline uint64_t xxhash64(const std::string &s, uint64_t seed = 0) noexcept {
+  return xxhash64(s.data(), s.size(), seed);
+}
+
+} // namespace coding
+
+#endif /* end of include guard: CODINGHASH_HPP */
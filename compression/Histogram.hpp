@@ -0,0 +1,247 @@
+#ifndef CODINGHISTOGRAM_HPP
+#define CODINGHISTOGRAM_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <CodingMeta.hpp>
+
+namespace coding {
+
+// symbol histogram over bytes, gathered in a single pass
+struct Histogram {
+  using count_t = uint64_t;
+  // interleaved count tables, so that runs of the same byte do not
+  // serialize on a load-store dependency through one counter
+  static constexpr int NO_TABLES = 4;
+  // inputs shorter than this are counted on the calling thread
+  static constexpr size_t PARALLEL_THRESHOLD = size_t(1) << 20;
+
+  std::array<count_t, 256> counts;
+  size_t total = 0;
+
+  Histogram():
+    counts()
+  {
+    counts.fill(0);
+  }
+
+  explicit Histogram(const std::string &text, int no_threads = 0):
+    Histogram()
+  {
+    add(text.data(), text.length(), no_threads);
+  }
+
+  void add(const char *text, size_t len, int no_threads = 0) {
+    if(no_threads <= 0) {
+      no_threads = std::max<int>(1, std::thread::hardware_concurrency());
+    }
+    if(len < PARALLEL_THRESHOLD || no_threads == 1) {
+      add_serial(text, len);
+      return;
+    }
+    // partition the input, count each part separately and merge
+    no_threads = std::min<size_t>(no_threads, len / (PARALLEL_THRESHOLD >> 2));
+    std::vector<Histogram> parts(no_threads);
+    std::vector<std::thread> threads;
+    const size_t step = len / no_threads;
+    for(int i = 0; i < no_threads; ++i) {
+      const size_t from = i * step;
+      const size_t to = (i == no_threads - 1) ? len : from + step;
+      threads.emplace_back([&, i, from, to]() {
+        parts[i].add_serial(text + from, to - from);
+      });
+    }
+    for(auto &t : threads) {
+      t.join();
+    }
+    for(auto &h : parts) {
+      merge(h);
+    }
+  }
+
+  void add_serial(const char *text, size_t len) noexcept {
+    count_t c[NO_TABLES][256];
+    std::memset(c, 0, sizeof(c));
+    const auto *s = reinterpret_cast<const unsigned char *>(text);
+    size_t i = 0;
+    // eight bytes per load, spread over the tables
+    for(; i + 8 <= len; i += 8) {
+      uint64_t w;
+      std::memcpy(&w, s + i, sizeof(w));
+      ++c[0][uint8_t(w)];
+      ++c[1][uint8_t(w >> 8)];
+      ++c[2][uint8_t(w >> 16)];
+      ++c[3][uint8_t(w >> 24)];
+      ++c[0][uint8_t(w >> 32)];
+      ++c[1][uint8_t(w >> 40)];
+      ++c[2][uint8_t(w >> 48)];
+      ++c[3][uint8_t(w >> 56)];
+    }
+    for(; i < len; ++i) {
+      ++c[0][s[i]];
+    }
+    for(int j = 0; j < 256; ++j) {
+      counts[j] += c[0][j] + c[1][j] + c[2][j] + c[3][j];
+    }
+    total += len;
+  }
+
+  void merge(const Histogram &other) noexcept {
+    for(int j = 0; j < 256; ++j) {
+      counts[j] += other.counts[j];
+    }
+    total += other.total;
+  }
+
+  count_t count(char c) const noexcept {
+    return counts[uint8_t(c)];
+  }
+
+  size_t size() const noexcept {
+    return total;
+  }
+
+  // symbols that occur at least once, in byte order
+  std::string alphabet() const {
+    std::string a;
+    for(int j = 0; j < 256; ++j) {
+      if(counts[j]) {
+        a += char(j);
+      }
+    }
+    return a;
+  }
+
+  std::vector<float> probabilities(const std::string &alphabet) const {
+    std::vector<float> p(alphabet.length(), 0.f);
+    if(total == 0) {
+      return p;
+    }
+    for(int i = 0; i < alphabet.length(); ++i) {
+      p[i] = double(count(alphabet[i])) / total;
+    }
+    return p;
+  }
+
+  CodingMeta meta(std::string alphabet) const {
+    auto p = probabilities(alphabet);
+    return CodingMeta(alphabet, p);
+  }
+
+  CodingMeta meta() const {
+    return meta(alphabet());
+  }
+
+  // empirical entropy, bits per symbol
+  double entropy() const {
+    double h = 0.;
+    for(auto &q : counts) {
+      if(q) {
+        double p = double(q) / total;
+        h -= p * std::log2(p);
+      }
+    }
+    return h;
+  }
+
+  // number of bits an ideal coder for the given model would spend on the text
+  double ideal_length(const CodingMeta &meta) const {
+    double len = 0.;
+    for(int i = 0; i < meta.size(); ++i) {
+      auto q = count(meta.get_char(i));
+      if(q) {
+        len -= q * std::log2(meta.get_prob(i));
+      }
+    }
+    return len;
+  }
+
+  double ideal_length() const {
+    return entropy() * total;
+  }
+};
+
+// histogram over wide symbols, only symbols that occur take memory
+template <typename Sym>
+struct SparseHistogram {
+  using count_t = uint64_t;
+  using meta_type = BasicCodingMeta<Sym>;
+  using string_type = typename meta_type::string_type;
+
+  std::unordered_map<Sym, count_t> counts;
+  size_t total = 0;
+
+  SparseHistogram() {}
+
+  explicit SparseHistogram(const string_type &text) {
+    add(text.data(), text.size());
+  }
+
+  void add(const Sym *text, size_t len) {
+    for(size_t i = 0; i < len; ++i) {
+      ++counts[text[i]];
+    }
+    total += len;
+  }
+
+  count_t count(Sym c) const {
+    auto it = counts.find(c);
+    return it == counts.end() ? 0 : it->second;
+  }
+
+  size_t size() const noexcept {
+    return total;
+  }
+
+  // symbols that occur at least once, ascending
+  string_type alphabet() const {
+    string_type a;
+    a.reserve(counts.size());
+    for(auto &c : counts) {
+      a.push_back(c.first);
+    }
+    std::sort(a.begin(), a.end());
+    return a;
+  }
+
+  std::vector<float> probabilities(const string_type &alphabet) const {
+    std::vector<float> p(alphabet.size(), 0.f);
+    if(total == 0) {
+      return p;
+    }
+    for(size_t i = 0; i < alphabet.size(); ++i) {
+      p[i] = double(count(alphabet[i])) / total;
+    }
+    return p;
+  }
+
+  meta_type meta(string_type alphabet) const {
+    auto p = probabilities(alphabet);
+    return meta_type(alphabet, p);
+  }
+
+  meta_type meta() const {
+    return meta(alphabet());
+  }
+
+  double entropy() const {
+    double h = 0.;
+    for(auto &c : counts) {
+      double p = double(c.second) / total;
+      h -= p * std::log2(p);
+    }
+    return h;
+  }
+};
+
+} // namespace coding
+
+#endif /* end of include guard: CODINGHISTOGRAM_HPP */
@@ -2,12 +2,18 @@
 #define CODINGHUFFMAN_HPP
 
 #include <limits>
+#include <algorithm>
 #include <array>
+#include <memory>
+#include <vector>
 
 #include <utility>
 #include <type_traits>
 
 #include <Base.hpp>
+#include <Arena.hpp>
+#include <Model.hpp>
+#include <Trace.hpp>
 
 namespace coding {
 
@@ -105,6 +111,23 @@ public:
     parent.add_child(*this);
   }
 
+  size_t depth() const noexcept {
+    size_t d = 0;
+    for(auto n = this; n->parent != nullptr; n = n->parent) {
+      ++d;
+    }
+    return d;
+  }
+
+  // writes depth() bits into the buffer, root to leaf
+  template <typename = std::enable_if<N == 2>>
+  void get_code(bool *bits, size_t depth) const noexcept {
+    auto n = this;
+    for(size_t i = depth; i > 0; --i, n = n->parent) {
+      bits[i - 1] = n->childno_;
+    }
+  }
+
   template <typename = std::enable_if<N == 2>>
   void get_code(DynamicBitset &bset) const noexcept {
     if(parent == nullptr) {
@@ -126,8 +149,11 @@ public:
   }
 };
 
-struct Huffman {
+template <typename Sym>
+struct BasicHuffman {
   using number_t = uint32_t;
+  using meta_type = BasicCodingMeta<Sym>;
+  using string_type = typename meta_type::string_type;
 
   template <typename T>
   static void swap(T &x, T &y) {
@@ -135,15 +161,19 @@ struct Huffman {
     T t = x; x = y; y = t;
   }
 
+  // sorts both by x, ascending
   template <typename X, typename Y>
   static void sort(X &x, Y &y) {
-    for(int i = 0; i < x.size() - 1; ++i) {
-      for(int j = i + 1; j < x.size(); ++j) {
-        if(x[i] > x[j]) {
-          swap(x[i], x[j]);
-          swap(y[i], y[j]);
-        }
-      }
+    std::vector<size_t> order(x.size());
+    for(size_t i = 0; i < order.size(); ++i) {
+      order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t i, size_t j) { return x[i] < x[j]; });
+    const X xs(x);
+    const Y ys(y);
+    for(size_t i = 0; i < order.size(); ++i) {
+      x[i] = xs[order[i]];
+      y[i] = ys[order[i]];
     }
   }
 
@@ -151,32 +181,71 @@ struct Huffman {
   static constexpr int ceil_log2(T x) {
     auto t = x, r = 0;
     while(t>>=1)r+=1;
-    return r-((1<<r==x)?1:0);
+    return r + ((T(1) << r) == x ? 0 : 1);
   }
 
-  const CodingMeta &meta;
+  // keeps a shared model alive, meta refers to it
+  std::shared_ptr<const meta_type> shared_meta;
+  const meta_type &meta;
   HuffmanNode<2> *huffman_tree;
-  // huffman tree stored altogether
-  std::vector<HuffmanNode<2>> leaves_;
-  std::vector<HuffmanNode<2>> nodes_;
+  // built with the codec and only read from then on, so one codec serves
+  // any number of threads: the huffman tree, the symbols sorted by
+  // probability and the code table
+  Arena scratch;
+  HuffmanNode<2> *leaves_ = nullptr;
+  HuffmanNode<2> *nodes_ = nullptr;
+  Sym *symbols_ = nullptr;
+  float *probs_ = nullptr;
+  // code table built by begin(): offsets into one buffer of code bits and
+  // lengths by sorted position, the sorted position of every alphabet index
+  bool *code_bits_ = nullptr;
+  size_t *code_offsets_ = nullptr;
+  size_t *code_lengths_ = nullptr;
+  size_t *sorted_ = nullptr;
+  size_t max_code_length_ = 0;
+  // optional instrumentation, not to be shared between threads
+  Trace *trace = nullptr;
+
+  BasicHuffman(const meta_type &meta):
+    meta(meta),
+    huffman_tree(nullptr)
+  {
+    build();
+  }
+
+  BasicHuffman(std::shared_ptr<const meta_type> meta):
+    BasicHuffman(*meta)
+  {
+    shared_meta = std::move(meta);
+  }
 
-  Huffman(const CodingMeta &meta):
+  // the tree and the code table of a compiled model, copied
+  BasicHuffman(const meta_type &meta, const CompiledModel &model):
     meta(meta),
     huffman_tree(nullptr)
-  {}
+  {
+    load(model);
+  }
 
-  DynamicBitset encode(const std::string &text) {
-    DynamicBitset bset;
-    // sort this using bucket sort, for example
+  BasicHuffman(const BasicHuffman &) = delete;
+  BasicHuffman &operator=(const BasicHuffman &) = delete;
+
+  // builds the tree and the code table
+  void build() {
     auto len = meta.size();
-    auto a = meta.alphabet();
-    auto p = meta.probabilities();
+    if(len == 0) {
+      return;
+    }
+    arena_vector<Sym> a(meta.alphabet().begin(), meta.alphabet().end(), scratch);
+    arena_vector<float> p(meta.probabilities().begin(), meta.probabilities().end(), scratch);
     sort(p, a);
+    symbols_ = a.data();
+    probs_ = p.data();
     // huffman coding
     int i = 0, j = 0;
-    std::vector<float> q(len, 1.0f);
-    leaves_ = std::vector<HuffmanNode<2>>(len);
-    nodes_ = std::vector<HuffmanNode<2>>(len);
+    arena_vector<float> q(len, 1.0f, scratch);
+    leaves_ = scratch.make_array<HuffmanNode<2>>(len);
+    nodes_ = scratch.make_array<HuffmanNode<2>>(len);
     // extract min in constant time N-1 times
     for(int i = 0; i < len; ++i) {
       leaves_[i].set_index(i);
@@ -197,57 +266,213 @@ struct Huffman {
         j += 2;
       }
     }
-    // encode
-    std::vector<DynamicBitset> dict(256);
+    // code table
+    auto offsets = code_offsets_ = scratch.make_array<size_t>(len);
+    auto lengths = code_lengths_ = scratch.make_array<size_t>(len);
+    size_t total = 0, max_length = 0;
     for(int i = 0; i < len; ++i) {
-      dict[uint8_t(a[i])] = leaves_[i].get_code();
+      lengths[i] = std::max<size_t>(1, leaves_[i].depth());
+      total += lengths[i];
+      max_length = std::max(max_length, lengths[i]);
     }
-    for(auto &ch : text) {
-      bset.append(dict[uint8_t(ch)]);
+    max_code_length_ = max_length;
+    auto bits = code_bits_ = scratch.make_array<bool>(total);
+    auto sorted = sorted_ = scratch.make_array<size_t>(len);
+    for(int i = 0; i < len; ++i) {
+      sorted[meta.find_char(a[i])] = i;
+    }
+    for(int i = 0, pos = 0; i < len; ++i) {
+      offsets[i] = pos;
+      // a lone symbol is coded as a single zero
+      leaves_[i].get_code(bits + pos, leaves_[i].depth());
+      pos += lengths[i];
     }
-    // set the attribute
     huffman_tree = (len > 1) ? &nodes_[len - 2] : &leaves_[0];
+  }
+
+  // a node of the tree by number: leaves first, then inner nodes
+  int32_t node_id(const HuffmanNode<2> *node) const noexcept {
+    const int32_t len = meta.size();
+    return (node >= leaves_ && node < leaves_ + len) ? int32_t(node - leaves_) : int32_t(len + (node - nodes_));
+  }
+
+  void save(ModelImage &image) const {
+    const size_t len = meta.size();
+    if(len == 0) {
+      return;
+    }
+    std::vector<uint32_t> order(len), lengths(len);
+    std::vector<int32_t> tree;
+    for(size_t i = 0; i < len; ++i) {
+      order[sorted_[i]] = i;
+      lengths[i] = code_lengths_[i];
+    }
+    for(size_t k = 0; k + 1 < len; ++k) {
+      tree.push_back(node_id(nodes_[k].child(0)));
+      tree.push_back(node_id(nodes_[k].child(1)));
+    }
+    const size_t total = code_offsets_[len - 1] + code_lengths_[len - 1];
+    image.add(CompiledModel::HUFFMAN_ORDER, order);
+    image.add(CompiledModel::HUFFMAN_TREE, tree);
+    image.add(CompiledModel::HUFFMAN_CODE_LENGTHS, lengths);
+    image.add(CompiledModel::HUFFMAN_CODE_BITS, reinterpret_cast<const uint8_t *>(code_bits_), total);
+  }
+
+  // what build() makes, from a compiled model: children are linked in
+  // the order they were saved, inner nodes only to earlier ones
+  void load(const CompiledModel &model) {
+    if(!model.matches(meta)) {
+      throw std::runtime_error("the compiled model is of another alphabet or probabilities");
+    }
+    const size_t len = meta.size();
+    if(len == 0) {
+      return;
+    }
+    auto order = model.section<uint32_t>(CompiledModel::HUFFMAN_ORDER, len);
+    auto tree = model.section<int32_t>(CompiledModel::HUFFMAN_TREE, 2 * (len - 1));
+    auto lengths = model.section<uint32_t>(CompiledModel::HUFFMAN_CODE_LENGTHS, len);
+    symbols_ = scratch.make_array<Sym>(len);
+    probs_ = scratch.make_array<float>(len);
+    sorted_ = scratch.make_array<size_t>(len);
+    std::fill(sorted_, sorted_ + len, len);
+    for(size_t i = 0; i < len; ++i) {
+      if(order[i] >= len || sorted_[order[i]] != len) {
+        throw std::runtime_error("corrupt compiled model");
+      }
+      symbols_[i] = meta.get_char(order[i]);
+      probs_[i] = meta.get_prob(order[i]);
+      sorted_[order[i]] = i;
+    }
+    leaves_ = scratch.make_array<HuffmanNode<2>>(len);
+    nodes_ = scratch.make_array<HuffmanNode<2>>(len);
+    for(size_t i = 0; i < len; ++i) {
+      leaves_[i].set_index(i);
+      nodes_[i].set_index(len + i);
+    }
+    auto node = [&](int32_t id, size_t k) -> HuffmanNode<2> & {
+      if(id < 0 || size_t(id) >= len + k) {
+        throw std::runtime_error("corrupt compiled model");
+      }
+      return size_t(id) < len ? leaves_[id] : nodes_[id - len];
+    };
+    for(size_t k = 0; k + 1 < len; ++k) {
+      nodes_[k].add_child(node(tree[2 * k], k));
+      nodes_[k].add_child(node(tree[2 * k + 1], k));
+    }
+    code_offsets_ = scratch.make_array<size_t>(len);
+    code_lengths_ = scratch.make_array<size_t>(len);
+    size_t total = 0;
+    max_code_length_ = 0;
+    for(size_t i = 0; i < len; ++i) {
+      code_offsets_[i] = total;
+      code_lengths_[i] = lengths[i];
+      total += lengths[i];
+      max_code_length_ = std::max(max_code_length_, code_lengths_[i]);
+    }
+    auto bits = model.section<uint8_t>(CompiledModel::HUFFMAN_CODE_BITS, total);
+    code_bits_ = scratch.make_array<bool>(total);
+    for(size_t i = 0; i < total; ++i) {
+      code_bits_[i] = bits[i];
+    }
+    huffman_tree = (len > 1) ? &nodes_[len - 2] : &leaves_[0];
+  }
+
+  // codes only depend on the model, a message needs no state to be
+  // encoded piecewise
+  void begin() {}
+
+  // appends the codes of more text
+  void encode_more(const string_type &text, DynamicBitset &bset) const {
+    Trace::Timer encode_timer(trace, "huffman.encode");
+    if(trace) {
+      trace->peak("huffman.max_code_length", max_code_length_);
+    }
+    for(auto &ch : text) {
+      const auto x = meta.find_char(ch);
+      if(x == meta_type::npos) {
+        throw std::domain_error("symbol outside of the alphabet");
+      }
+      const auto k = sorted_[x];
+      auto code = code_bits_ + code_offsets_[k];
+      for(size_t b = 0; b < code_lengths_[k]; ++b) {
+        bset.append_bit(code[b]);
+      }
+    }
+  }
+
+  // a prefix code needs no terminator
+  void finish(DynamicBitset &) const {}
+
+  // bits of a message of n symbols at most
+  size_t max_encoded_size(size_t n) const noexcept {
+    return n * max_code_length_;
+  }
+
+  // length of the code of the symbol at alphabet index x
+  size_t code_length(size_t x) const noexcept {
+    return code_lengths_[sorted_[x]];
+  }
+
+  // into a reused buffer, returns the number of bits
+  size_t encode(const string_type &text, DynamicBitset &bset) const {
+    bset.clear();
+    encode_more(text, bset);
+    return bset.size();
+  }
+
+  DynamicBitset encode(const string_type &text) const {
+    DynamicBitset bset;
+    encode(text, bset);
     return bset;
   }
 
-  double average_length() {
+  double average_length() const {
     double avglen = 0.;
-    auto a = meta.alphabet();
-    auto p = meta.probabilities();
-    sort(p, a);
-    std::vector<int> lengths(meta.size(), 0);
     for(int i = 0; i < meta.size(); ++i) {
-      avglen += p[i] * leaves_[i].get_code().size();
+      avglen += probs_[i] * std::max<size_t>(1, leaves_[i].depth());
     }
     return avglen;
   }
 
   // take a tree visitor and follow the code, emit on leaves
-  std::string decode(const DynamicBitset &bset) {
-    auto len = meta.size();
-    auto a = meta.alphabet();
-    auto p = meta.probabilities();
-    sort(p, a);
+  string_type decode(const DynamicBitset &bset) const {
+    string_type s;
+    decode(bset, s);
+    return s;
+  }
+
+  // into a reused buffer, returns the number of symbols
+  size_t decode(const DynamicBitset &bset, string_type &s) const {
+    Trace::Timer timer(trace, "huffman.decode");
+    s.clear();
+    if(huffman_tree == nullptr) {
+      if(bset.size()) {
+        throw std::domain_error("unable to fully decode the text");
+      }
+      return 0;
+    }
+    // symbols sorted along with the tree
+    const Sym *a = symbols_;
     // decode
     auto vis = huffman_tree;
-    std::string s = "";
-    DynamicBitset cur;
     for(int i = 0; i < bset.size(); ++i) {
       if(!vis->is_leaf()) {
         vis = vis->child(bset[i]);
       }
       if(vis->is_leaf()) {
-        s += a[vis->index()];
+        s.push_back(a[vis->index()]);
         vis = huffman_tree;
       }
     }
     if(!vis->is_root()) {
       throw std::domain_error("unable to fully decode the text");
     }
-    return s;
+    return s.size();
   }
 };
 
+using Huffman = BasicHuffman<char>;
+
 } // namespace coding
 
 #endif /* end of include guard: CODINGHUFFMAN_HPP */
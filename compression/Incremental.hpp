@@ -0,0 +1,143 @@
+#ifndef CODINGINCREMENTAL_HPP
+#define CODINGINCREMENTAL_HPP
+
+#include <string>
+#include <utility>
+
+#include <Base.hpp>
+#include <Trace.hpp>
+
+namespace coding {
+
+namespace detail {
+
+// width of the codes a coder has written, for those that write all codes
+// again when it grows (LZW); 0 for the others
+template <typename Coder>
+auto code_width(const Coder &coder, int) -> decltype(int(coder.code_width())) {
+  return coder.code_width();
+}
+
+template <typename Coder>
+int code_width(const Coder &, long) {
+  return 0;
+}
+
+} // namespace detail
+
+// a message that grows at the end, as typed text does. the coder keeps its
+// state between calls (Huffman its code table, Arithmetic its interval and
+// pending bits, LZ77 its window, LZW the phrase being extended), so
+// append encodes the new symbols only and reports which bits changed: the
+// code of the whole message is code() followed by tail(), both kept here
+// and handed out by reference. appending n symbols costs O(n), but for
+// LZW, which writes all codes again each time their width grows, that is
+// once per doubling of its dictionary.
+//
+// encode(text) is for callers that only have the whole text: it encodes
+// the new symbols as append does, but checks the old text against the new
+// one and returns a copy of the whole code, which is O(total). any other
+// edit than an append starts the message over.
+//
+// the coder must have begin, encode_more and a const finish that appends
+// the terminating bits. the code is not always a plain encode's: LZ77
+// sizes its window for a stream of unknown length.
+template <typename Coder>
+struct Incremental {
+  Coder coder;
+  // optional instrumentation
+  Trace *trace = nullptr;
+  // the message so far, its code without the terminating bits and those
+  std::string text_;
+  DynamicBitset bset_;
+  DynamicBitset tail_;
+  bool started_ = false;
+
+  template <typename... Args>
+  explicit Incremental(Args &&...args):
+    coder(std::forward<Args>(args)...)
+  {}
+
+  // the coder outlives calls, its probes only point at the trace during one
+  struct Attached {
+    Coder &coder;
+    Attached(Coder &coder, Trace *trace): coder(coder) {
+      attach_trace(coder, trace);
+    }
+    ~Attached() {
+      attach_trace(coder, nullptr);
+    }
+  };
+
+  void reset() {
+    started_ = false;
+    text_.clear();
+    bset_ = DynamicBitset();
+    tail_ = DynamicBitset();
+  }
+
+  // appends to the message and returns the first bit of code() that is
+  // new or was written again; the bits before it are as they were. the
+  // terminating bits of the message so far are then in tail()
+  size_t append(const std::string &more) {
+    Attached attached(coder, trace);
+    if(!started_) {
+      coder.begin();
+      started_ = true;
+    }
+    const size_t before = bset_.size();
+    const int width = detail::code_width(coder, 0);
+    try {
+      coder.encode_more(more, bset_);
+    } catch(...) {
+      // the coder may have taken part of the text
+      reset();
+      throw;
+    }
+    text_ += more;
+    tail_.clear();
+    coder.finish(tail_);
+    return detail::code_width(coder, 0) == width ? before : 0;
+  }
+
+  // as above, out gets the bits of code() from the returned position on
+  size_t append(const std::string &more, DynamicBitset &out) {
+    const size_t from = append(more);
+    out = bset_.slice(from, bset_.size() - from);
+    return from;
+  }
+
+  // the code of the whole message as a copy, see above
+  DynamicBitset encode(const std::string &text) {
+    if(!started_ || text.compare(0, text_.length(), text_) != 0) {
+      reset();
+    }
+    append(text.substr(text_.length()));
+    auto bset = bset_;
+    bset.append(tail_);
+    return bset;
+  }
+
+  std::string decode(const DynamicBitset &bset) {
+    Attached attached(coder, trace);
+    return coder.decode(bset);
+  }
+
+  const std::string &text() const noexcept {
+    return text_;
+  }
+
+  // the code of the message but its terminating bits
+  const DynamicBitset &code() const noexcept {
+    return bset_;
+  }
+
+  // the bits that terminate the message so far
+  const DynamicBitset &tail() const noexcept {
+    return tail_;
+  }
+};
+
+} // namespace coding
+
+#endif /* end of include guard: CODINGINCREMENTAL_HPP */
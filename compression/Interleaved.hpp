@@ -0,0 +1,269 @@
+#ifndef CODINGINTERLEAVED_HPP
+#define CODINGINTERLEAVED_HPP
+
+#include <cstdint>
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <Base.hpp>
+#include <BitIO.hpp>
+#include <Canonical.hpp>
+#include <Model.hpp>
+#include <Trace.hpp>
+
+namespace coding {
+
+// huffman code in blocks of four streams, in the style of huff0. a block
+// is cut into four quarters that are coded one after the other, with the
+// sizes of the streams up front, so the decoder finds all four at once and
+// decodes them in lockstep. the streams do not depend on each other: an
+// out-of-order core overlaps their table lookups instead of waiting for
+// one code to end before the next can be looked up.
+//
+// codes are canonical, from the model's probabilities, and at most
+// MAX_LENGTH bits long, so a symbol is one lookup of max_length bits.
+//
+// layout per block: the number of symbols, the sizes of the four streams
+// in SIZE_BITS each, then the streams.
+struct InterleavedHuffman {
+  static constexpr int STREAMS = 4;
+  // short codes keep the decoding table in the first level cache
+  static constexpr int MAX_LENGTH = 11;
+  static constexpr int LENGTH_BITS = 32;
+  static constexpr int SIZE_BITS = 32;
+  static constexpr size_t DEFAULT_BLOCK_SIZE = 1 << 16;
+  static constexpr size_t MAX_BLOCK_SIZE = 1 << 24;
+  // probabilities become integer weights of this precision
+  static constexpr int WEIGHT_BITS = 24;
+
+  // per-message decoder state: the streams of a block packed into words
+  struct Decoder {
+    std::vector<uint64_t> words;
+  };
+
+  // keeps a shared model alive, meta refers to it
+  std::shared_ptr<const CodingMeta> shared_meta;
+  const CodingMeta &meta;
+  const size_t block_size;
+  // over alphabet indices, every symbol of the alphabet has a code
+  CanonicalCode code;
+  // optional instrumentation, not to be shared between threads
+  Trace *trace = nullptr;
+
+  InterleavedHuffman(const CodingMeta &meta, size_t block_size = DEFAULT_BLOCK_SIZE):
+    meta(meta),
+    block_size(block_size)
+  {
+    if(block_size == 0 || block_size > MAX_BLOCK_SIZE) {
+      throw std::runtime_error("block size out of range");
+    }
+    std::vector<uint64_t> weights(meta.size());
+    for(size_t i = 0; i < meta.size(); ++i) {
+      weights[i] = std::max<uint64_t>(1, uint64_t(double(meta.get_prob(i)) * (uint64_t(1) << WEIGHT_BITS)));
+    }
+    code = CanonicalCode(CanonicalCode::code_lengths(weights.data(), weights.size(), MAX_LENGTH));
+  }
+
+  InterleavedHuffman(std::shared_ptr<const CodingMeta> meta, size_t block_size = DEFAULT_BLOCK_SIZE):
+    InterleavedHuffman(*meta, block_size)
+  {
+    shared_meta = std::move(meta);
+  }
+
+  // the code and decoding table of a compiled model, copied
+  InterleavedHuffman(const CodingMeta &meta, const CompiledModel &model, size_t block_size = DEFAULT_BLOCK_SIZE):
+    meta(meta),
+    block_size(block_size)
+  {
+    if(block_size == 0 || block_size > MAX_BLOCK_SIZE) {
+      throw std::runtime_error("block size out of range");
+    }
+    if(!model.matches(meta)) {
+      throw std::runtime_error("the compiled model is of another alphabet or probabilities");
+    }
+    const size_t n = meta.size();
+    auto lengths = model.section<uint8_t>(CompiledModel::CANONICAL_LENGTHS, n);
+    auto codes = model.section<uint32_t>(CompiledModel::CANONICAL_CODES, n);
+    code.lengths.assign(lengths, lengths + n);
+    code.codes.assign(codes, codes + n);
+    code.max_length = 0;
+    for(auto l : code.lengths) {
+      code.max_length = std::max<int>(code.max_length, l);
+    }
+    if(code.max_length > MAX_LENGTH) {
+      throw std::runtime_error("corrupt compiled model");
+    }
+    auto table = model.section<uint16_t>(CompiledModel::CANONICAL_TABLE, size_t(1) << code.max_length);
+    code.table.assign(table, table + (size_t(1) << code.max_length));
+    for(auto entry : code.table) {
+      if((entry >> CanonicalCode::LENGTH_BITS) >= std::max<size_t>(n, 1)) {
+        throw std::runtime_error("corrupt compiled model");
+      }
+    }
+  }
+
+  void save(ModelImage &image) const {
+    image.add(CompiledModel::CANONICAL_LENGTHS, code.lengths);
+    image.add(CompiledModel::CANONICAL_CODES, code.codes);
+    image.add(CompiledModel::CANONICAL_TABLE, code.table);
+  }
+
+  // symbols in each of the four streams of a block of n
+  static size_t stream_length(size_t n, int s) noexcept {
+    const size_t quarter = (n + STREAMS - 1) / STREAMS;
+    const size_t from = std::min(n, quarter * s);
+    return std::min(quarter, n - from);
+  }
+
+  static void put(DynamicBitset &bset, uint64_t x, int bits) {
+    for(int i = bits - 1; i >= 0; --i) {
+      bset.append_bit((x >> i) & 1);
+    }
+  }
+
+  // overwrites bits already in place
+  static void put_at(DynamicBitset &bset, size_t pos, uint64_t x, int bits) {
+    for(int i = 0; i < bits; ++i) {
+      bset[pos + i] = (x >> (bits - i - 1)) & 1;
+    }
+  }
+
+  // bits of a message of n symbols at most
+  size_t max_encoded_size(size_t n) const noexcept {
+    const size_t blocks = (n + block_size - 1) / block_size;
+    return blocks * (LENGTH_BITS + STREAMS * SIZE_BITS) + n * code.max_length;
+  }
+
+  DynamicBitset encode(const std::string &text) const {
+    DynamicBitset bset;
+    encode(text, bset);
+    return bset;
+  }
+
+  // into a reused buffer, returns the number of bits. the stream sizes
+  // are filled in once the streams are written
+  size_t encode(const std::string &text, DynamicBitset &bset) const {
+    Trace::Timer timer(trace, "interleaved.encode");
+    bset.clear();
+    for(size_t from = 0; from < text.length(); from += block_size) {
+      const size_t n = std::min(block_size, text.length() - from);
+      put(bset, n, LENGTH_BITS);
+      const size_t sizes = bset.size();
+      for(int s = 0; s < STREAMS; ++s) {
+        put(bset, 0, SIZE_BITS);
+      }
+      size_t i = from;
+      for(int s = 0; s < STREAMS; ++s) {
+        const size_t start = bset.size();
+        for(size_t k = stream_length(n, s); k > 0; --k, ++i) {
+          const auto x = meta.find_char(text[i]);
+          if(x == CodingMeta::npos) {
+            throw std::domain_error("symbol outside of the alphabet");
+          }
+          code.encode(bset, x);
+        }
+        put_at(bset, sizes + s * SIZE_BITS, bset.size() - start, SIZE_BITS);
+      }
+    }
+    if(trace) {
+      trace->count("interleaved.blocks", (text.length() + block_size - 1) / block_size);
+    }
+    return bset.size();
+  }
+
+  std::string decode(const DynamicBitset &bset) const {
+    std::string s;
+    Decoder d;
+    decode(d, bset, s);
+    return s;
+  }
+
+  size_t decode(const DynamicBitset &bset, std::string &s) const {
+    Decoder d;
+    return decode(d, bset, s);
+  }
+
+  // into a reused buffer with a reused decoder, returns the number of
+  // symbols
+  size_t decode(Decoder &d, const DynamicBitset &bset, std::string &s) const {
+    Trace::Timer timer(trace, "interleaved.decode");
+    s.clear();
+    const int max_length = code.max_length;
+    const uint16_t *table = code.table.data();
+    const char *symbols = meta.alphabet().data();
+    const uint16_t len_mask = (1 << CanonicalCode::LENGTH_BITS) - 1;
+    size_t pos = 0;
+    while(pos < bset.size()) {
+      if(pos + LENGTH_BITS + STREAMS * SIZE_BITS > bset.size()) {
+        throw std::domain_error("truncated block header");
+      }
+      const size_t n = bset.get_bits(pos, LENGTH_BITS);
+      pos += LENGTH_BITS;
+      if(n == 0 || n > MAX_BLOCK_SIZE || max_length == 0) {
+        throw std::domain_error("invalid block length");
+      }
+      size_t sizes[STREAMS], starts[STREAMS];
+      d.words.clear();
+      size_t from = pos + STREAMS * SIZE_BITS;
+      for(int k = 0; k < STREAMS; ++k) {
+        sizes[k] = bset.get_bits(pos + k * SIZE_BITS, SIZE_BITS);
+        if(from + sizes[k] > bset.size()) {
+          throw std::domain_error("truncated block");
+        }
+        starts[k] = pack_bits(bset, from, sizes[k], d.words);
+        from += sizes[k];
+      }
+      pos = from;
+      BitReader r[STREAMS];
+      for(int k = 0; k < STREAMS; ++k) {
+        r[k] = BitReader{d.words.data() + starts[k], 0};
+      }
+      // four quarters, the last one the shortest
+      const size_t out = s.size();
+      const size_t quarter = stream_length(n, 0), last = stream_length(n, STREAMS - 1);
+      s.resize(out + n);
+      char *dst[STREAMS];
+      for(int k = 0; k < STREAMS; ++k) {
+        dst[k] = &s[out + std::min(n, quarter * k)];
+      }
+      // a code not in the table has length zero
+      uint16_t invalid = 0;
+      auto step = [&](int k, size_t i) {
+        const auto entry = table[r[k].peek(max_length)];
+        r[k].pos += entry & len_mask;
+        invalid |= (entry & len_mask) == 0;
+        dst[k][i] = symbols[entry >> CanonicalCode::LENGTH_BITS];
+      };
+      size_t i = 0;
+      for(; i < last; ++i) {
+        step(0, i), step(1, i), step(2, i), step(3, i);
+        // the readers never get further than a code past their stream
+        if((r[0].pos > sizes[0]) | (r[1].pos > sizes[1]) | (r[2].pos > sizes[2]) | (r[3].pos > sizes[3])) {
+          throw std::domain_error("unable to fully decode the text");
+        }
+      }
+      for(int k = 0; k < STREAMS - 1; ++k) {
+        for(size_t j = i; j < stream_length(n, k); ++j) {
+          step(k, j);
+          if(r[k].pos > sizes[k]) {
+            throw std::domain_error("unable to fully decode the text");
+          }
+        }
+      }
+      for(int k = 0; k < STREAMS; ++k) {
+        invalid |= r[k].pos != sizes[k];
+      }
+      if(invalid) {
+        throw std::domain_error("unable to fully decode the text");
+      }
+    }
+    return s.size();
+  }
+};
+
+} // namespace coding
+
+#endif /* end of include guard: CODINGINTERLEAVED_HPP */
@@ -1,53 +1,149 @@
 #ifndef CODINGLZ77_HPP
 #define CODINGLZ77_HPP
 
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include <Base.hpp>
+#include <BitIO.hpp>
+#include <Dictionary.hpp>
+#include <Trace.hpp>
+#include <Universal.hpp>
 
 namespace coding {
 
 // adapted from https://github.com/manassra/LZ77-Compressor
 struct LZ77 {
+  // candidates examined per position
+  static constexpr int MAX_CHAIN = 64;
+
+  // how a match is written after its flag. Fixed: the distance and the
+  // length in the widths of the window and the lookahead. Universal: both
+  // in rice codes whose parameters follow the matches so far, so near
+  // and short matches are cheap and the window can grow at little cost
+  enum class Tokens {
+    Fixed, Universal
+  };
+
+  // keeps a shared model alive, meta refers to it
+  std::shared_ptr<const CodingMeta> shared_meta;
   const CodingMeta &meta;
+  // optional preset content that precedes every message
+  std::shared_ptr<const Dictionary> dictionary;
+  // the decoder needs the encoder's
+  const Tokens tokens;
 
-  LZ77(const CodingMeta &meta):
-    meta(meta)
+  LZ77(const CodingMeta &meta, std::shared_ptr<const Dictionary> dictionary = nullptr, Tokens tokens = Tokens::Fixed):
+    meta(meta),
+    dictionary(dictionary),
+    tokens(tokens)
   {}
 
+  LZ77(std::shared_ptr<const CodingMeta> meta, std::shared_ptr<const Dictionary> dictionary = nullptr, Tokens tokens = Tokens::Fixed):
+    LZ77(*meta, dictionary, tokens)
+  {
+    shared_meta = std::move(meta);
+  }
+
+  // streams encoded piecewise are configured for this length
+  static constexpr size_t DEFAULT_STREAM_LENGTH = 1 << 20;
+
+  // window and lookahead of a message, the decoder needs the encoder's
+  struct Window {
+    int size;
+    int lookahead;
+  };
+
+  // per-message encoder state: the window in front of the next symbol,
+  // which starts at absolute position buf_start (the dictionary is at 0),
+  // and hash chains over absolute positions, the older links in a ring.
+  // the codec itself is only read, so it serves any number of encoders
+  struct Encoder {
+    Window window = Window{-1, -1};
+    std::string buf;
+    int64_t buf_start = 0;
+    int64_t end = 0;
+    // positions from here on are not in the chains yet
+    int64_t hashed = 0;
+    std::vector<int64_t> head;
+    std::vector<int64_t> prev;
+    AdaptiveRice distances;
+    AdaptiveRice lengths;
+
+    char at(int64_t pos) const noexcept {
+      return buf[pos - buf_start];
+    }
+  };
+
+  // per-message decoder state: universal tokens packed into words
+  struct Decoder {
+    std::vector<uint64_t> words;
+  };
+
+  // the window of the last message, for the calls that do not take one
   int window_size = -1;
-  int textsize = -1;
   int lookahead_size = -1;
+  // the message encoded by begin, encode_more and finish
+  Encoder state_;
+  // for the buffer overload that takes neither decoder nor window
+  Decoder decoder_;
+  // optional instrumentation, not to be shared between threads
+  Trace *trace = nullptr;
 
-  static std::string repeat(std::string &&s, int times) {
-    std::string ret;
-    ret.reserve(times * s.length());
-    for(int i = 0; i < times; ++i) {
-      for(int j = 0; j < s.length(); ++j) {
-        ret += s[j];
+  // longest match for position i among earlier positions with the same
+  // hash: first those of the message, then the dictionary's
+  std::pair<int, int> find_longest_match(const Encoder &e, int64_t i, int64_t end) const {
+    auto ret = std::make_pair(0, 0);
+    if(i + HashChain::MIN_MATCH > end) {
+      return ret;
+    }
+    const char *buf = e.buf.data() + (i - e.buf_start);
+    const int window_size = e.window.size;
+    const int maxlen = std::min<int64_t>(e.window.lookahead - 1, end - i);
+    const auto h = HashChain::hash(buf);
+    const HashChain *shared = dictionary ? &dictionary->chain() : nullptr;
+    const size_t mask = e.prev.size() - 1;
+    int chain = MAX_CHAIN;
+    auto consider = [&](int64_t j) {
+      const char *cand = buf - (i - j);
+      int len = 0;
+      // overlapping matches repeat the period, which is all in the buffer
+      while(len < maxlen && cand[len] == buf[len]) {
+        ++len;
+      }
+      if(len > ret.second) {
+        ret.first = i - j;
+        ret.second = len;
       }
+    };
+    for(int64_t j = e.head[h]; j != -1 && chain > 0 && i - j <= window_size; j = e.prev[j & mask], --chain) {
+      consider(j);
     }
-    return ret;
-  }
-
-  // inefficient, but works
-  std::pair<int, int> find_longest_match(const std::string &text, int i) {
-    auto ret = std::make_pair(0, -1);
-    auto bufsize = std::min<int>(i + lookahead_size, text.length()) - i;
-    for(int end = i + 2; end < i + bufsize; ++end) {
-      auto start = std::max<int>(0, i - window_size);
-      auto s = text.substr(i, end - i);
-      for(int j = start; j < i; ++j) {
-        auto rep = s.length() / (i - j);
-        auto last = s.length() % (i - j);
-        auto s_matched = repeat(text.substr(j, i-j), rep) + text.substr(j, last);
-        if(s_matched == s && s.length() > ret.second) {
-          ret.first = i - j;
-          ret.second = s.length();
-        }
+    if(shared != nullptr) {
+      for(int64_t j = shared->head[h]; j != -1 && chain > 0 && i - j <= window_size; j = shared->prev[j], --chain) {
+        consider(j);
       }
     }
     return ret;
   }
 
+  // window and lookahead for a message of the given length
+  Window window_for(size_t length) const {
+    const int dsize = dictionary ? dictionary->size() : 0;
+    Window w;
+    w.lookahead = std::min<int>(length, std::max<int>(10 + std::log(length), 15));
+    w.size = std::max<int>(std::cbrt(length), dsize);
+    return w;
+  }
+
+  void configure(size_t length) {
+    const auto w = window_for(length);
+    window_size = w.size;
+    lookahead_size = w.lookahead;
+  }
+
   // copied around so dont have to include special utility func
   static constexpr auto ceil_log2(long n) {
     int x = 0;
@@ -56,54 +152,236 @@ struct LZ77 {
     return x;
   }
 
-  DynamicBitset encode(const std::string &text) {
-    DynamicBitset bset;
+  // starts a message of about the given length, which fixes the window
+  // and the code widths; more text is added with encode_more
+  void begin(Encoder &e, size_t length = DEFAULT_STREAM_LENGTH) const {
+    e.window = window_for(length);
+    // assigned in place, a reused encoder keeps its memory
+    if(dictionary) {
+      e.buf.assign(dictionary->content());
+    } else {
+      e.buf.clear();
+    }
+    e.buf_start = 0;
+    e.end = e.hashed = e.buf.length();
+    e.head.assign(1 << HashChain::HASH_BITS, -1);
+    size_t ring = 1;
+    while(ring <= size_t(e.window.size)) {
+      ring <<= 1;
+    }
+    e.prev.assign(ring, -1);
+    e.distances = e.lengths = AdaptiveRice();
+  }
 
-    lookahead_size = std::min<int>(text.length(), std::max<int>(10 + std::log(text.length()), 15));
-    window_size = std::cbrt(text.length());
+  // appends the tokens of more text, after begin(). a piece is parsed on
+  // its own, matches do not reach into text that has not arrived yet
+  void encode_more(Encoder &e, const std::string &text, DynamicBitset &bset) const {
+    Trace::Timer timer(trace, "lz77.encode");
+    uint64_t literals = 0, matches = 0;
+    // match histograms, recorded once the piece is parsed; matches are
+    // shorter than the lookahead
+    std::vector<uint64_t> match_lengths(trace ? e.window.lookahead : 0);
+    uint64_t match_distances_log2[64] = {};
     auto bits_sym = ceil_log2(meta.size());
-    auto bits_distsize = ceil_log2(window_size);
-    auto bits_lookahead = ceil_log2(lookahead_size);
-    for(int i = 0; i < text.length();) {
-      auto match = find_longest_match(text, i);
-      match.first -= i;
-      if(match.second > 0) {
-      // encode the match
+    auto bits_distsize = ceil_log2(e.window.size);
+    auto bits_lookahead = ceil_log2(e.window.lookahead);
+    // a match only pays off if it is shorter than the literals it replaces
+    const int min_match = std::max<int>(int(HashChain::MIN_MATCH), (1 + bits_distsize + bits_lookahead) / (1 + bits_sym) + 1);
+
+    e.buf += text;
+    const int64_t end = e.end + text.length();
+    const size_t mask = e.prev.size() - 1;
+    // chains take every position that has MIN_MATCH symbols after it
+    auto insert_upto = [&](int64_t pos) {
+      for(; e.hashed < pos && e.hashed + HashChain::MIN_MATCH <= end; ++e.hashed) {
+        auto h = HashChain::hash(e.buf.data() + (e.hashed - e.buf_start));
+        e.prev[e.hashed & mask] = e.head[h];
+        e.head[h] = e.hashed;
+      }
+    };
+    insert_upto(e.end);
+
+    const bool universal = tokens == Tokens::Universal;
+    for(int64_t i = e.end; i < end;) {
+      auto match = find_longest_match(e, i, end);
+      const bool take = universal
+        ? match.second >= HashChain::MIN_MATCH && match_size(e, match) < match.second * (1 + bits_sym)
+        : match.second >= min_match;
+      if(take) {
+      // encode the match, distances start from 1
         bset.append_bit(1);
-        for(int i = 0; i < bits_distsize+bits_lookahead; ++i) {
-          if(i < bits_distsize) {
-            auto bit = 1 << (bits_distsize - i - 1);
-            bset.append_bit(match.first & bit);
-          } else {
-            int j = i - bits_distsize;
-            auto bit = 1 << (bits_lookahead - j - 1);
-            bset.append_bit(match.second & bit);
+        if(universal) {
+          e.distances.encode(bset, match.first - 1);
+          e.lengths.encode(bset, match.second - HashChain::MIN_MATCH);
+        } else {
+          for(int k = 0; k < bits_distsize+bits_lookahead; ++k) {
+            if(k < bits_distsize) {
+              auto bit = 1 << (bits_distsize - k - 1);
+              bset.append_bit((match.first - 1) & bit);
+            } else {
+              int j = k - bits_distsize;
+              auto bit = 1 << (bits_lookahead - j - 1);
+              bset.append_bit(match.second & bit);
+            }
           }
         }
+        if(trace) {
+          ++match_lengths[match.second];
+          ++match_distances_log2[ceil_log2(match.first)];
+        }
+        ++matches;
         i += match.second;
       } else {
       // emit raw symbol
         bset.append_bit(0);
-        auto ind = meta.find_char(text[i]);
-        for(int i = 0; i < bits_sym; ++i) {
-          bset.append_bit(ind & (1 << (bits_sym - i - 1)));
+        auto ind = meta.find_char(e.at(i));
+        if(ind == CodingMeta::npos) {
+          throw std::domain_error("symbol outside of the alphabet");
+        }
+        for(int k = 0; k < bits_sym; ++k) {
+          bset.append_bit(ind & (1 << (bits_sym - k - 1)));
         }
+        ++literals;
         ++i;
       }
+      insert_upto(i);
+    }
+    e.end = end;
+    // keep the window, drop the rest once it is as long again
+    const int64_t keep = int64_t(e.window.size) + 1;
+    if(end - e.buf_start > 2 * keep + (1 << 16)) {
+      e.buf.erase(0, end - keep - e.buf_start);
+      e.buf_start = end - keep;
     }
+    if(trace) {
+      trace->count("lz77.literals", literals);
+      trace->count("lz77.matches", matches);
+      for(size_t k = 0; k < match_lengths.size(); ++k) {
+        if(match_lengths[k]) {
+          trace->record("lz77.match_length", k, match_lengths[k]);
+        }
+      }
+      for(int k = 0; k < 64; ++k) {
+        if(match_distances_log2[k]) {
+          trace->record("lz77.match_distance_log2", k, match_distances_log2[k]);
+        }
+      }
+    }
+  }
+
+  // bits of a universal match token
+  static int match_size(const Encoder &e, std::pair<int, int> match) noexcept {
+    return 1 + Rice::size(match.first - 1, e.distances.parameter()) + Rice::size(match.second - HashChain::MIN_MATCH, e.lengths.parameter());
+  }
+
+  // tokens need no terminator
+  void finish(const Encoder &, DynamicBitset &) const {}
+
+  // bits of a message of n symbols at most: matches are only taken when
+  // shorter than their literals
+  size_t max_encoded_size(size_t n) const noexcept {
+    return n * (1 + ceil_log2(meta.size()));
+  }
+
+  // a whole message, its window is stored for the decoder
+  DynamicBitset encode(const std::string &text, Window &window) const {
+    DynamicBitset bset;
+    Encoder e;
+    encode(e, text, bset);
+    window = e.window;
     return bset;
   }
 
-  bool next_bit(const DynamicBitset &bset, int &i) {
+  // into a reused buffer with a reused encoder, returns the number of
+  // bits; the window is left in the encoder
+  size_t encode(Encoder &e, const std::string &text, DynamicBitset &bset) const {
+    bset.clear();
+    begin(e, text.length());
+    encode_more(e, text, bset);
+    return bset.size();
+  }
+
+  void begin(size_t length = DEFAULT_STREAM_LENGTH) {
+    begin(state_, length);
+    window_size = state_.window.size;
+    lookahead_size = state_.window.lookahead;
+  }
+
+  void encode_more(const std::string &text, DynamicBitset &bset) {
+    encode_more(state_, text, bset);
+  }
+
+  void finish(DynamicBitset &) const {}
+
+  DynamicBitset encode(const std::string &text) {
+    DynamicBitset bset;
+    encode(text, bset);
+    return bset;
+  }
+
+  size_t encode(const std::string &text, DynamicBitset &bset) {
+    encode(state_, text, bset);
+    window_size = state_.window.size;
+    lookahead_size = state_.window.lookahead;
+    return bset.size();
+  }
+
+  // a token cut short is damage, not zeros
+  static bool next_bit(const DynamicBitset &bset, int &i) {
+    if(i >= bset.size()) {
+      throw std::domain_error("truncated token");
+    }
     return bset[i++];
   }
 
-  std::string decode(const DynamicBitset &bset) {
-    auto bits_sym = ceil_log2(meta.size());
-    auto bits_distsize = ceil_log2(window_size);
-    auto bits_lookahead = ceil_log2(lookahead_size);
+  std::string decode(const DynamicBitset &bset) const {
+    return decode(bset, Window{window_size, lookahead_size});
+  }
+
+  size_t decode(const DynamicBitset &bset, std::string &s) {
+    return decode(decoder_, bset, Window{window_size, lookahead_size}, s);
+  }
+
+  std::string decode(const DynamicBitset &bset, const Window &window) const {
     std::string s;
-    for(int i = 0; i < bset.size();) {
+    Decoder d;
+    decode(d, bset, window, s);
+    return s;
+  }
+
+  size_t decode(const DynamicBitset &bset, const Window &window, std::string &s) const {
+    Decoder d;
+    return decode(d, bset, window, s);
+  }
+
+  // into a reused buffer with a reused decoder, returns the number of
+  // symbols. the dictionary is decoded in front of the message and moved
+  // out at the end
+  size_t decode(Decoder &d, const DynamicBitset &bset, const Window &window, std::string &s) const {
+    Trace::Timer timer(trace, "lz77.decode");
+    if(dictionary) {
+      s.assign(dictionary->content());
+    } else {
+      s.clear();
+    }
+    const auto dsize = s.length();
+    if(tokens == Tokens::Universal) {
+      decode_universal(d, bset, window, s);
+      s.erase(0, dsize);
+      return s.length();
+    }
+    decode_tokens(bset, 0, window, s);
+    s.erase(0, dsize);
+    return s.length();
+  }
+
+  // fixed tokens from bit from on, appended to s, which holds the symbols
+  // they may refer to
+  void decode_tokens(const DynamicBitset &bset, size_t from, const Window &window, std::string &s) const {
+    auto bits_sym = ceil_log2(meta.size());
+    auto bits_distsize = ceil_log2(window.size);
+    auto bits_lookahead = ceil_log2(window.lookahead);
+    for(int i = from; i < bset.size();) {
       auto flag = next_bit(bset, i);
       if(flag) {
       // decode the match
@@ -120,6 +398,11 @@ struct LZ77 {
             }
           }
         }
+        // distances start from 1
+        ++match.first;
+        if(size_t(match.first) > s.length()) {
+          throw std::domain_error("match out of range");
+        }
         for(int j = 0; j < match.second; ++j) {
           s += s[s.length() - match.first];
         }
@@ -131,10 +414,109 @@ struct LZ77 {
             ind |= (1 << (bits_sym - j - 1));
           }
         }
+        if(size_t(ind) >= meta.size()) {
+          throw std::domain_error("symbol outside of the alphabet");
+        }
         s += meta.get_char(ind);
       }
     }
-    return s;
+  }
+
+  // continues a message of fixed tokens: s holds what the bits before from
+  // decoded to, behind the dictionary if there is one, and gets the rest.
+  // the tokens need nothing else from the earlier bits, so text appended
+  // to an encoded message decodes in time of its own length
+  void decode_more(const DynamicBitset &bset, size_t from, const Window &window, std::string &s) const {
+    if(tokens != Tokens::Fixed) {
+      throw std::runtime_error("only fixed tokens decode from the middle of a message");
+    }
+    Trace::Timer timer(trace, "lz77.decode");
+    decode_tokens(bset, from, window, s);
+  }
+
+  // universal tokens after whatever s holds
+  void decode_universal(Decoder &d, const DynamicBitset &bset, const Window &window, std::string &s) const {
+    auto tokens = read_tokens(d, bset, window);
+    while(!tokens.done()) {
+      const auto t = tokens.next(s.length());
+      if(t.length) {
+        for(uint64_t j = 0; j < t.length; ++j) {
+          s += s[s.length() - t.distance];
+        }
+      } else {
+        s += meta.get_char(t.literal);
+      }
+    }
+  }
+
+  // a match of length symbols at distance, or if length is 0 the
+  // alphabet index of a literal
+  struct Token {
+    uint64_t distance;
+    uint64_t length;
+    uint64_t literal;
+  };
+
+  // reads universal tokens, a quotient in one count of leading zeros,
+  // and checks them against the stream, the lookahead and the alphabet;
+  // the decoder and the search share it, so both reject the same streams
+  struct TokenReader {
+    BitReader r;
+    size_t end;
+    int bits_sym;
+    uint64_t alphabet_size;
+    // the encoder's matches reach no further back than its window and
+    // are shorter than its lookahead
+    uint64_t max_distance;
+    uint64_t max_length;
+    AdaptiveRice distances;
+    AdaptiveRice lengths;
+
+    bool done() const noexcept {
+      return r.pos >= end;
+    }
+
+    // the next token after available symbols, the dictionary's included
+    Token next(uint64_t available) {
+      Token t{0, 0, 0};
+      if(r.read(1)) {
+        t.distance = distances.decode(r) + 1;
+        if(r.pos > end) {
+          throw std::domain_error("truncated match");
+        }
+        t.length = lengths.decode(r) + HashChain::MIN_MATCH;
+        if(r.pos > end) {
+          throw std::domain_error("truncated match");
+        }
+        if(t.distance > available || t.distance > max_distance) {
+          throw std::domain_error("match out of range");
+        }
+        if(t.length > max_length) {
+          throw std::domain_error("match too long");
+        }
+      } else {
+        t.literal = r.read(bits_sym);
+        if(r.pos > end) {
+          throw std::domain_error("truncated literal");
+        }
+        if(t.literal >= alphabet_size) {
+          throw std::domain_error("symbol outside of the alphabet");
+        }
+      }
+      return t;
+    }
+  };
+
+  // the tokens of a message, packed into the decoder's words
+  TokenReader read_tokens(Decoder &d, const DynamicBitset &bset, const Window &window) const {
+    d.words.clear();
+    d.words.reserve(bset.size() / 64 + 1 + PACK_PADDING);
+    pack_bits(bset, 0, bset.size(), d.words);
+    return TokenReader{
+      BitReader{d.words.data(), 0}, bset.size(), ceil_log2(meta.size()), meta.size(),
+      uint64_t(std::max(window.size, 0)), uint64_t(std::max(window.lookahead - 1, 0)),
+      AdaptiveRice(), AdaptiveRice()
+    };
   }
 };
 
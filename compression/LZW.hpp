@@ -1,52 +1,46 @@
 #ifndef CODINGLZW_HPP
 #define CODINGLZW_HPP
 
-#include <Base.hpp>
+#include <algorithm>
+#include <memory>
+#include <vector>
 
-#include <unordered_map>
-#include <array>
+#include <Base.hpp>
+#include <Arena.hpp>
+#include <Dictionary.hpp>
+#include <Trace.hpp>
 
 namespace coding {
 
-template <size_t N = 256>
-struct Tree {
-  std::array<Tree *, N> sub = {nullptr};
-  char c;
-  uint64_t val;
-  Tree(char c, uint64_t val):
-    c(c), val(val)
-  {}
-
-  void add(unsigned char c, uint64_t v) {
-    sub[c] = new Tree<N>(c, v);
-  }
-
-  bool has(unsigned char c) const noexcept {
-    return sub[c] != nullptr;
-  }
-
-  Tree<N> *child(unsigned char c) {
-    return sub[c];
-  }
-
-  void free() {
-    for(int i = 0; i < N; ++i) {
-      if(sub[i]) {
-        sub[i]->free();
-        delete sub[i];
-      }
-    }
-  }
-};
-
 struct LZW {
   static constexpr char END_OF_TEXT = EOF;
 
+  // keeps a shared model alive, meta refers to it
+  std::shared_ptr<const CodingMeta> shared_meta;
   const CodingMeta &meta;
+  // optional preset phrases, the alphabet must match the meta's
+  std::shared_ptr<const Dictionary> dictionary;
+  // alphabet index of every byte, -1 outside of the alphabet
+  int64_t symbol_code_[256];
+
+  LZW(const CodingMeta &meta, std::shared_ptr<const Dictionary> dictionary = nullptr):
+    meta(meta),
+    dictionary(dictionary)
+  {
+    if(dictionary && dictionary->alphabet() != meta.alphabet()) {
+      throw std::runtime_error("dictionary alphabet does not match");
+    }
+    std::fill(symbol_code_, symbol_code_ + 256, -1);
+    for(int i = 0; i < meta.size(); ++i) {
+      symbol_code_[uint8_t(meta.get_char(i))] = i;
+    }
+  }
 
-  LZW(const CodingMeta &meta):
-    meta(meta)
-  {}
+  LZW(std::shared_ptr<const CodingMeta> meta, std::shared_ptr<const Dictionary> dictionary = nullptr):
+    LZW(*meta, dictionary)
+  {
+    shared_meta = std::move(meta);
+  }
 
   static constexpr auto ceil_log2(long n) {
     int x = 0;
@@ -55,43 +49,194 @@ struct LZW {
     return x;
   }
 
+  // per-message encoder state: the phrase being extended, the phrases
+  // learned so far and the codes, of which the first written are in the
+  // caller's bits at written_width each. the codec itself is only read,
+  // so it serves any number of encoders
+  struct Encoder {
+    // phrase tables, rewound per message
+    Arena tables;
+    PhraseTable local;
+    bool has_w = false;
+    uint64_t w = 0;
+    uint64_t size = 0;
+    uint64_t learned = 0;
+    std::vector<uint64_t> codes;
+    size_t written = 0;
+    int written_width = 0;
+    // code width of the message so far, the decoder needs it
+    int block_size = -1;
+
+    // the table is kept at most half full
+    void grow_table() {
+      PhraseTable bigger;
+      const auto cap = local.capacity() * 2;
+      bigger.init(tables.make_array<uint64_t>(cap), tables.make_array<uint64_t>(cap), cap);
+      for(size_t i = 0; i < local.capacity(); ++i) {
+        if(local.keys[i] != 0) {
+          const auto k = local.keys[i] - 1;
+          bigger.insert(k >> 8, k & 0xFF, local.values[i]);
+        }
+      }
+      local = bigger;
+    }
+  };
+
+  // code width of the last message, for the calls that do not take one
   int block_size = -1;
+  // the message encoded by begin, encode_more and finish
+  Encoder state_;
+  // optional instrumentation, not to be shared between threads
+  Trace *trace = nullptr;
 
-  DynamicBitset encode(const std::string &text_) {
-    auto text = text_ + END_OF_TEXT;
-    DynamicBitset bset;
-    Tree<256> dict(0,0);
-    int size = 0;
-    std::vector<uint64_t> codes;
-    for(auto a : meta.alphabet()) {
-      dict.add(a, size++);
-    }
-    Tree<256> *w = &dict;
-    for(auto c : text) {
-      if(c == END_OF_TEXT) {
-        codes.push_back(w->val);
-        break;
+  // starts a message; length is a hint that sizes the phrase table
+  void begin(Encoder &e, size_t length = 0) const {
+    e.tables.reset();
+    e.size = dictionary ? dictionary->lzw_size() : meta.size();
+    e.learned = 0;
+    const auto cap = PhraseTable::capacity_for(length + 1);
+    e.local.init(e.tables.make_array<uint64_t>(cap), e.tables.make_array<uint64_t>(cap), cap);
+    e.has_w = false;
+    e.w = 0;
+    e.codes.clear();
+    e.written = 0;
+    e.written_width = 0;
+    e.block_size = ceil_log2(e.size);
+  }
+
+  // the trie is a hash table of (code, symbol) pairs: phrases learned from
+  // the message go to a local table, the dictionary's are looked up in place.
+  // codes have the width of the final dictionary, so when it gains a bit
+  // the codes in bset are written again; bset must hold this message only
+  void encode_more(Encoder &e, const std::string &text_, DynamicBitset &bset) const {
+    Trace::Timer timer(trace, "lzw.encode");
+    const PhraseTable *shared = dictionary ? &dictionary->lzw_table() : nullptr;
+    const auto before = e.codes.size();
+    for(auto c : text_) {
+      const auto code = symbol_code_[uint8_t(c)];
+      if(code < 0) {
+        throw std::domain_error("symbol outside of the alphabet");
+      }
+      uint64_t x;
+      if(!e.has_w) {
+        e.w = code, e.has_w = true;
+      } else if((shared && shared->find(e.w, c, x)) || e.local.find(e.w, c, x)) {
+        e.w = x;
       } else {
-        if(w->has(c)) {
-          w = w->child(c);
-        } else {
-          codes.push_back(w->val);
-          w->add(c, size++);
-          w = dict.child(c);
+        e.codes.push_back(e.w);
+        if(2 * (e.learned + 1) > e.local.capacity()) {
+          e.grow_table();
+        }
+        e.local.insert(e.w, c, e.size++);
+        ++e.learned;
+        e.w = code;
+        // growth of the dictionary, once per extra bit of code width
+        if(trace && (e.size & (e.size - 1)) == 0) {
+          trace->sample("lzw.dictionary_size", e.size);
         }
       }
     }
-    block_size = ceil_log2(size);
-    for(auto &x : codes) {
-      for(int i = 0; i < block_size; ++i) {
-        bset.append_bit(x & (uint64_t(1) << (block_size - i - 1)));
+    const int width = e.block_size = ceil_log2(e.size);
+    if(width != e.written_width) {
+      bset.clear();
+      e.written = 0;
+      e.written_width = width;
+    }
+    for(; e.written < e.codes.size(); ++e.written) {
+      const auto x = e.codes[e.written];
+      for(int i = 0; i < width; ++i) {
+        bset.append_bit(x & (uint64_t(1) << (width - i - 1)));
       }
     }
-    dict.free();
+    if(trace) {
+      trace->sample("lzw.dictionary_size", e.size);
+      trace->peak("lzw.dictionary_size", e.size);
+      trace->count("lzw.codes", e.codes.size() - before);
+    }
+  }
+
+  // the code of the phrase still being extended; the state is left as it
+  // was, append to a copy of the bits to keep encoding into the original
+  void finish(const Encoder &e, DynamicBitset &bset) const {
+    if(e.has_w) {
+      for(int i = 0; i < e.block_size; ++i) {
+        bset.append_bit(e.w & (uint64_t(1) << (e.block_size - i - 1)));
+      }
+    }
+  }
+
+  // per-message decoder state: the phrases learned from the message and
+  // the last code read, so that a message can be decoded in pieces. the
+  // phrases keep their storage from one message to the next
+  struct Decoder {
+    std::vector<Phrase> local;
+    uint64_t w = 0;
+    bool has_w = false;
+  };
+  // for the buffer overload that takes neither decoder nor width
+  Decoder decoder_;
+
+  // bits of a message of n symbols at most, one code per symbol
+  size_t max_encoded_size(size_t n) const noexcept {
+    const uint64_t size = dictionary ? dictionary->lzw_size() : meta.size();
+    return n * ceil_log2(size + n);
+  }
+
+  // a whole message, its code width is stored for the decoder
+  DynamicBitset encode(const std::string &text_, int &width) const {
+    DynamicBitset bset;
+    Encoder e;
+    encode(e, text_, bset);
+    width = e.block_size;
     return bset;
   }
 
-  uint64_t decode_symbol(const DynamicBitset &bset, int i) {
+  // into a reused buffer with a reused encoder, returns the number of
+  // bits; the code width is left in the encoder
+  size_t encode(Encoder &e, const std::string &text_, DynamicBitset &bset) const {
+    bset.clear();
+    begin(e, text_.length());
+    encode_more(e, text_, bset);
+    finish(e, bset);
+    return bset.size();
+  }
+
+  void begin(size_t length = 0) {
+    begin(state_, length);
+    block_size = state_.block_size;
+  }
+
+  void encode_more(const std::string &text_, DynamicBitset &bset) {
+    encode_more(state_, text_, bset);
+    block_size = state_.block_size;
+  }
+
+  void finish(DynamicBitset &bset) const {
+    finish(state_, bset);
+  }
+
+  // width of the codes written so far, they are all written again when
+  // it grows
+  int code_width() const noexcept {
+    return state_.written_width;
+  }
+
+  DynamicBitset encode(const std::string &text_) {
+    DynamicBitset bset;
+    encode(text_, bset);
+    return bset;
+  }
+
+  size_t encode(const std::string &text_, DynamicBitset &bset) {
+    encode(state_, text_, bset);
+    block_size = state_.block_size;
+    return bset.size();
+  }
+
+  static uint64_t decode_symbol(const DynamicBitset &bset, size_t i, int block_size) {
+    if(size_t(i) + block_size > bset.size()) {
+      throw std::domain_error("truncated code");
+    }
     uint64_t x = 0;
     for(int j = 0; j < block_size; ++j) {
       if(bset[i + j]) {
@@ -101,36 +246,120 @@ struct LZW {
     return x;
   }
 
-  std::string decode(const DynamicBitset &bset) {
+  std::string decode(const DynamicBitset &bset) const {
+    return decode(bset, block_size);
+  }
+
+  size_t decode(const DynamicBitset &bset, std::string &s) {
+    return decode(decoder_, bset, block_size, s);
+  }
+
+  std::string decode(const DynamicBitset &bset, int block_size) const {
     std::string s;
-    std::unordered_map<uint64_t, std::string> dict;
-    for(int i = 0; i < meta.size(); ++i) {
-      dict[dict.size()] = std::string() + meta.get_char(i);
+    Decoder d;
+    decode(d, bset, block_size, s);
+    return s;
+  }
+
+  // starts a message of about the given number of codes
+  void begin(Decoder &d, size_t codes = 0) const {
+    d.local.clear();
+    d.local.reserve(meta.size() + codes + 1);
+    if(!dictionary) {
+      for(int i = 0; i < meta.size(); ++i) {
+        d.local.push_back(Phrase{0, 1, meta.get_char(i), meta.get_char(i)});
+      }
+    }
+    d.w = 0;
+    d.has_w = false;
+  }
+
+  // codes below the dictionary's size are its phrases
+  const Phrase &phrase(const Decoder &d, uint64_t x) const {
+    const uint64_t base = dictionary ? dictionary->lzw_size() : 0;
+    return x < base ? dictionary->lzw_phrases()[x] : d.local[x - base];
+  }
+
+  uint64_t phrases(const Decoder &d) const {
+    return (dictionary ? dictionary->lzw_size() : 0) + d.local.size();
+  }
+
+  // every phrase is an earlier phrase plus one symbol: the dictionary is
+  // kept as arrays of prefix codes and written out back to front
+  void output(const Decoder &d, uint64_t x, std::string &s) const {
+    auto pos = s.length();
+    auto len = phrase(d, x).length;
+    s.resize(pos + len);
+    for(auto i = pos + len; i > pos; --i) {
+      s[i - 1] = phrase(d, x).last;
+      x = phrase(d, x).prefix;
     }
+  }
+
+  // into a reused buffer with a reused decoder, returns the number of
+  // symbols
+  size_t decode(Decoder &d, const DynamicBitset &bset, int block_size, std::string &s) const {
+    s.clear();
     if(bset.size() == 0) {
-      return s;
-    }
-    std::string w;
-    for(int i = 0; i < bset.size(); i += block_size) {
-      auto x = decode_symbol(bset, i);
-      if(!i) {
-        w = dict[x];
-        s += w;
+      return 0;
+    }
+    if(block_size <= 0) {
+      throw std::domain_error("code width unknown");
+    }
+    begin(d, bset.size() / block_size);
+    decode_more(d, bset, 0, block_size, s);
+    return s.length();
+  }
+
+  // the codes of bset from bit from on, all block_size wide, appended to
+  // what d has decoded into s so far
+  void decode_more(Decoder &d, const DynamicBitset &bset, size_t from, int block_size, std::string &s) const {
+    Trace::Timer timer(trace, "lzw.decode");
+    for(size_t i = from; i < bset.size(); i += block_size) {
+      const auto x = decode_symbol(bset, i, block_size);
+      const auto size = phrases(d);
+      if(!d.has_w) {
+        if(x >= size) {
+          throw std::domain_error("code out of range");
+        }
+        output(d, x, s);
+        d.w = x;
+        d.has_w = true;
         continue;
       }
-      std::string e;
-      if(dict.find(x) != dict.end()) {
-        e = dict[x];
-      } else if(x == dict.size()) {
-        e = w + w[0];
+      char c;
+      if(x < size) {
+        c = phrase(d, x).first;
+      } else if(x == size) {
+        c = phrase(d, d.w).first;
       } else {
-        throw std::runtime_error("compression failed");
+        throw std::domain_error("code out of range");
       }
-      s += e;
-      dict[dict.size()] = w + e[0];
-      w = e;
+      // the new phrase is w + c
+      const auto &w = phrase(d, d.w);
+      d.local.push_back(Phrase{d.w, w.length + 1, w.first, c});
+      output(d, x, s);
+      d.w = x;
+    }
+  }
+
+  // the code finish writes for the phrase still being extended, appended
+  // to s but not learned from, so that d can take the codes that follow
+  void decode_tail(const Decoder &d, const DynamicBitset &bset, int block_size, std::string &s) const {
+    if(bset.size() == 0) {
+      return;
+    }
+    const auto x = decode_symbol(bset, 0, block_size);
+    if(bset.size() != size_t(block_size) || x > phrases(d) || (x == phrases(d) && !d.has_w)) {
+      throw std::domain_error("code out of range");
+    }
+    if(x < phrases(d)) {
+      output(d, x, s);
+    } else {
+      // the phrase the encoder learned from the last code
+      output(d, d.w, s);
+      s += phrase(d, d.w).first;
     }
-    return s;
   }
 };
 
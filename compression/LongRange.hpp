@@ -0,0 +1,263 @@
+#ifndef CODINGLONGRANGE_HPP
+#define CODINGLONGRANGE_HPP
+
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <Base.hpp>
+#include <Arena.hpp>
+#include <LZ77.hpp>
+#include <Trace.hpp>
+
+namespace coding {
+
+// long-distance matching in front of LZ77, whose window only reaches
+// cbrt(n) back. a gear hash rolls over the message; positions whose hash
+// has its low SAMPLE_BITS clear are remembered in a table and looked up,
+// so repeats of MIN_MATCH symbols or more are found anywhere in the
+// window at a cost of one shift and add per symbol. what they do not
+// cover goes through LZ77 as one literal stream.
+//
+// layout: the message length, the number of long matches, for each the
+// literals before it, its distance and its length, the number of literals,
+// then the LZ77 code of the literals. numbers are stored as a 6-bit width less one and that
+// many bits, zero in one bit.
+struct LongRangeLZ77 {
+  // the gear hash covers the last 64 symbols
+  static constexpr int MIN_MATCH = 64;
+  // one position in 2^SAMPLE_BITS is remembered
+  static constexpr int SAMPLE_BITS = 4;
+  static constexpr int MIN_TABLE_BITS = 8;
+  static constexpr int MAX_TABLE_BITS = 22;
+  static constexpr int WIDTH_BITS = 6;
+  static constexpr uint64_t DEFAULT_WINDOW_SIZE = uint64_t(1) << 32;
+
+  struct Match {
+    uint64_t literals;
+    uint64_t distance;
+    uint64_t length;
+  };
+
+  // keeps a shared model alive, meta refers to it
+  std::shared_ptr<const CodingMeta> shared_meta;
+  const CodingMeta &meta;
+  uint64_t window_size;
+  // long matches of the last encoded message
+  std::vector<Match> matches;
+  LZ77 lz77;
+  // scratch memory for the hash table, rewound per message
+  Arena scratch;
+  double avglen = 0.;
+  // optional instrumentation
+  Trace *trace = nullptr;
+
+  LongRangeLZ77(const CodingMeta &meta, uint64_t window_size = DEFAULT_WINDOW_SIZE):
+    meta(meta),
+    window_size(window_size),
+    lz77(meta)
+  {}
+
+  LongRangeLZ77(std::shared_ptr<const CodingMeta> meta, uint64_t window_size = DEFAULT_WINDOW_SIZE):
+    LongRangeLZ77(*meta, window_size)
+  {
+    shared_meta = std::move(meta);
+  }
+
+  // random 64-bit values per symbol (splitmix64)
+  static const std::array<uint64_t, 256> &gear() {
+    static const std::array<uint64_t, 256> table = []() {
+      std::array<uint64_t, 256> t;
+      uint64_t x = 0;
+      for(auto &g : t) {
+        uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        g = z ^ (z >> 31);
+      }
+      return t;
+    }();
+    return table;
+  }
+
+  // widths 1 to 64 fit in WIDTH_BITS as width - 1
+  static void put_number(DynamicBitset &bset, uint64_t x) {
+    int width = 1;
+    while(width < 64 && (x >> width)) {
+      ++width;
+    }
+    for(int i = WIDTH_BITS - 1; i >= 0; --i) {
+      bset.append_bit(((width - 1) >> i) & 1);
+    }
+    for(int i = width - 1; i >= 0; --i) {
+      bset.append_bit((x >> i) & 1);
+    }
+  }
+
+  static uint64_t get_number(const DynamicBitset &bset, size_t &pos) {
+    if(pos + WIDTH_BITS > bset.size()) {
+      throw std::domain_error("truncated long match header");
+    }
+    const int width = bset.get_bits(pos, WIDTH_BITS) + 1;
+    if(pos + WIDTH_BITS + width > bset.size()) {
+      throw std::domain_error("truncated long match header");
+    }
+    pos += WIDTH_BITS;
+    const auto x = bset.get_bits(pos, width);
+    pos += width;
+    return x;
+  }
+
+  // long matches of the text, the literals between them appended to rest
+  void find_matches(const std::string &text, std::string &rest) {
+    Trace::Timer timer(trace, "long_range.scan");
+    matches.clear();
+    scratch.reset();
+    const size_t n = text.length();
+    int table_bits = MIN_TABLE_BITS;
+    while(table_bits < MAX_TABLE_BITS && (size_t(1) << table_bits) < (n >> SAMPLE_BITS)) {
+      ++table_bits;
+    }
+    // positions are stored plus one, zero is empty
+    auto table = scratch.make_array<uint64_t>(size_t(1) << table_bits);
+    const auto &g = gear();
+    const uint64_t sample_mask = (uint64_t(1) << SAMPLE_BITS) - 1;
+    uint64_t h = 0, matched = 0;
+    // start of the pending literals
+    size_t from = 0;
+    for(size_t i = 0; i < n; ++i) {
+      h = (h << 1) + g[uint8_t(text[i])];
+      if(i + 1 < MIN_MATCH || (h & sample_mask) != 0) {
+        continue;
+      }
+      auto &slot = table[h >> (64 - table_bits)];
+      const uint64_t j = slot;
+      slot = i + 1;
+      // positions inside the last match are only remembered
+      if(j == 0 || i < from) {
+        continue;
+      }
+      const size_t cand = j - 1;
+      if(i - cand > window_size) {
+        continue;
+      }
+      // extend both ways from the ends of the hashed windows
+      size_t back = 0;
+      while(back <= cand && i - back >= from && text[i - back] == text[cand - back]) {
+        ++back;
+      }
+      if(back < MIN_MATCH) {
+        continue;
+      }
+      size_t ahead = 1;
+      while(i + ahead < n && text[i + ahead] == text[cand + ahead]) {
+        ++ahead;
+      }
+      const size_t start = i + 1 - back, length = back + ahead - 1;
+      matches.push_back(Match{start - from, i - cand, length});
+      rest.append(text, from, start - from);
+      from = start + length;
+      matched += length;
+    }
+    rest.append(text, from, n - from);
+    if(trace) {
+      trace->count("long_range.matches", matches.size());
+      trace->count("long_range.matched_symbols", matched);
+    }
+  }
+
+  DynamicBitset encode(const std::string &text) {
+    Trace::Timer timer(trace, "long_range.encode");
+    DynamicBitset bset;
+    if(text.empty()) {
+      avglen = 0.;
+      return bset;
+    }
+    std::string rest;
+    find_matches(text, rest);
+    put_number(bset, text.length());
+    put_number(bset, matches.size());
+    for(auto &m : matches) {
+      put_number(bset, m.literals);
+      put_number(bset, m.distance);
+      put_number(bset, m.length);
+    }
+    put_number(bset, rest.length());
+    lz77.trace = trace;
+    auto literals = lz77.encode(rest);
+    bset.append(literals);
+    avglen = double(bset.size()) / text.length();
+    return bset;
+  }
+
+  // bits per symbol of the last message
+  double average_length() {
+    return avglen;
+  }
+
+  std::string decode(const DynamicBitset &bset) {
+    Trace::Timer timer(trace, "long_range.decode");
+    std::string s;
+    if(bset.size() == 0) {
+      return s;
+    }
+    size_t pos = 0;
+    const auto total = get_number(bset, pos);
+    const auto count = get_number(bset, pos);
+    // a match takes at least three numbers of one bit each
+    if(count > (bset.size() - pos) / (3 * (WIDTH_BITS + 1))) {
+      throw std::domain_error("too many long matches");
+    }
+    // kept apart from the matches of the last encoded message
+    std::vector<Match> matches;
+    // symbols of the message not yet accounted for by the header
+    uint64_t left = total, literals = 0;
+    for(uint64_t k = 0; k < count; ++k) {
+      Match m;
+      m.literals = get_number(bset, pos);
+      m.distance = get_number(bset, pos);
+      m.length = get_number(bset, pos);
+      if(m.literals > left || m.length > left - m.literals) {
+        throw std::domain_error("long match past the end of the text");
+      }
+      left -= m.literals + m.length;
+      literals += m.literals;
+      matches.push_back(m);
+    }
+    const auto nliterals = get_number(bset, pos);
+    // the literals after the last match fill up the rest
+    if(nliterals < literals || nliterals - literals != left) {
+      throw std::domain_error("unable to fully decode the text");
+    }
+    lz77.trace = trace;
+    const auto rest = lz77.decode(bset.slice(pos, bset.size() - pos), lz77.window_for(nliterals));
+    if(rest.length() != nliterals) {
+      throw std::domain_error("unable to fully decode the text");
+    }
+    size_t from = 0;
+    for(auto &m : matches) {
+      if(from + m.literals > rest.length()) {
+        throw std::domain_error("unable to fully decode the text");
+      }
+      s.append(rest, from, m.literals);
+      from += m.literals;
+      if(m.distance == 0 || m.distance > s.length()) {
+        throw std::domain_error("long match out of range");
+      }
+      // matches may overlap themselves
+      const size_t src = s.length() - m.distance;
+      for(uint64_t i = 0; i < m.length; ++i) {
+        s += s[src + i];
+      }
+    }
+    s.append(rest, from, rest.length() - from);
+    return s;
+  }
+};
+
+} // namespace coding
+
+#endif /* end of include guard: CODINGLONGRANGE_HPP */
@@ -0,0 +1,235 @@
+#ifndef CODINGMODEL_HPP
+#define CODINGMODEL_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <CodingMeta.hpp>
+#include <Hash.hpp>
+
+namespace coding {
+
+// the tables codecs derive from a CodingMeta, compiled once into a byte
+// image, a mapped file or a buffer. codecs are loaded from a compiled
+// image: they copy their tables out of it instead of building them from
+// the probabilities, and check that it was compiled from their alphabet
+// and probabilities. the image itself is not read while coding.
+//
+// layout, in host byte order: a header, a table of sections, then the
+// sections at 8-byte aligned offsets. the checksum covers everything
+// after the header; an image of another version, byte order or checksum
+// is rejected and compiled again by its user.
+class CompiledModel {
+public:
+  static constexpr uint32_t MAGIC = 0x4C444D43; // "CMDL"
+  static constexpr uint32_t VERSION = 2;
+
+  enum Section : uint32_t {
+    ALPHABET = 1,
+    PROBABILITIES,
+    // alphabet index of every symbol in the order of the code, the tree
+    // as child pairs per inner node, then code lengths and code bits
+    HUFFMAN_ORDER,
+    HUFFMAN_TREE,
+    HUFFMAN_CODE_LENGTHS,
+    HUFFMAN_CODE_BITS,
+    SHANNON_ORDER,
+    SHANNON_CODE_LENGTHS,
+    SHANNON_CODE_BITS,
+    ARITHMETIC_SUMS,
+    CANONICAL_LENGTHS,
+    CANONICAL_CODES,
+    CANONICAL_TABLE
+  };
+
+  struct Header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint64_t checksum;
+    uint32_t symbols;
+    uint32_t sections;
+  };
+
+  struct Entry {
+    uint32_t id;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+  };
+
+private:
+  // keeps the image alive, a mapping or a buffer
+  std::shared_ptr<const void> owner_;
+  const char *data_;
+  size_t size_;
+  Header header_;
+
+  const Entry *find(uint32_t id) const noexcept {
+    auto entries = reinterpret_cast<const Entry *>(data_ + sizeof(Header));
+    for(uint32_t i = 0; i < header_.sections; ++i) {
+      if(entries[i].id == id) {
+        return &entries[i];
+      }
+    }
+    return nullptr;
+  }
+
+public:
+  CompiledModel(const void *data, size_t size, std::shared_ptr<const void> owner):
+    owner_(std::move(owner)),
+    data_(static_cast<const char *>(data)),
+    size_(size)
+  {
+    if(size < sizeof(Header) || reinterpret_cast<uintptr_t>(data) % alignof(uint64_t)) {
+      throw std::runtime_error("not a compiled model");
+    }
+    std::memcpy(&header_, data_, sizeof(Header));
+    if(header_.magic != MAGIC || header_.version != VERSION) {
+      throw std::runtime_error("not a compiled model of this version");
+    }
+    if(header_.sections > (size - sizeof(Header)) / sizeof(Entry)) {
+      throw std::runtime_error("truncated compiled model");
+    }
+    if(xxhash64(data_ + sizeof(Header), size - sizeof(Header)) != header_.checksum) {
+      throw std::runtime_error("corrupt compiled model");
+    }
+    auto entries = reinterpret_cast<const Entry *>(data_ + sizeof(Header));
+    for(uint32_t i = 0; i < header_.sections; ++i) {
+      if(entries[i].offset % alignof(uint64_t) || entries[i].offset > size || entries[i].size > size - entries[i].offset) {
+        throw std::runtime_error("corrupt compiled model");
+      }
+    }
+  }
+
+  uint64_t key() const noexcept {
+    return header_.key;
+  }
+
+  size_t symbols() const noexcept {
+    return header_.symbols;
+  }
+
+  const void *data() const noexcept {
+    return data_;
+  }
+
+  size_t size() const noexcept {
+    return size_;
+  }
+
+  bool has(Section id) const noexcept {
+    return find(id) != nullptr;
+  }
+
+  // elements of type T in a section
+  template <typename T>
+  size_t count(Section id) const {
+    auto e = find(id);
+    if(e == nullptr) {
+      throw std::runtime_error("section missing from the compiled model");
+    }
+    if(e->size % sizeof(T)) {
+      throw std::runtime_error("corrupt compiled model");
+    }
+    return e->size / sizeof(T);
+  }
+
+  // a section of exactly n elements, read in place
+  template <typename T>
+  const T *section(Section id, size_t n) const {
+    if(count<T>(id) != n) {
+      throw std::runtime_error("corrupt compiled model");
+    }
+    return reinterpret_cast<const T *>(data_ + find(id)->offset);
+  }
+
+  // compiled from this alphabet and these probabilities
+  template <typename Sym>
+  bool matches(const BasicCodingMeta<Sym> &meta) const {
+    const size_t n = meta.size();
+    if(n != symbols() || !has(ALPHABET) || !has(PROBABILITIES)) {
+      return false;
+    }
+    if(count<char>(ALPHABET) != n * sizeof(Sym) || count<float>(PROBABILITIES) != n) {
+      return false;
+    }
+    return n == 0 || (std::memcmp(section<char>(ALPHABET, n * sizeof(Sym)), &meta.alphabet()[0], n * sizeof(Sym)) == 0
+                      && std::memcmp(section<float>(PROBABILITIES, n), meta.probabilities().data(), n * sizeof(float)) == 0);
+  }
+};
+
+// names a model by its alphabet and probabilities
+template <typename Sym>
+uint64_t model_key(const BasicCodingMeta<Sym> &meta) noexcept {
+  const uint64_t n = meta.size();
+  XXHash64 h;
+  h.update(&n, sizeof(n));
+  if(n > 0) {
+    h.update(&meta.alphabet()[0], n * sizeof(Sym));
+    h.update(meta.probabilities().data(), n * sizeof(float));
+  }
+  return h.digest();
+}
+
+// assembles the image of a compiled model section by section
+class ModelImage {
+  uint64_t key_;
+  uint32_t symbols_;
+  std::vector<std::pair<uint32_t, std::string>> sections_;
+
+public:
+  template <typename Sym>
+  explicit ModelImage(const BasicCodingMeta<Sym> &meta):
+    key_(model_key(meta)),
+    symbols_(meta.size())
+  {
+    const size_t n = meta.size();
+    add(CompiledModel::ALPHABET, n ? &meta.alphabet()[0] : nullptr, n);
+    add(CompiledModel::PROBABILITIES, meta.probabilities().data(), n);
+  }
+
+  template <typename T>
+  void add(CompiledModel::Section id, const T *data, size_t n) {
+    sections_.emplace_back(id, std::string(reinterpret_cast<const char *>(data), n * sizeof(T)));
+  }
+
+  template <typename T>
+  void add(CompiledModel::Section id, const std::vector<T> &v) {
+    add(id, v.data(), v.size());
+  }
+
+  std::string bytes() const {
+    auto align = [](size_t x) {
+      return (x + alignof(uint64_t) - 1) & ~(alignof(uint64_t) - 1);
+    };
+    std::vector<CompiledModel::Entry> entries;
+    size_t offset = sizeof(CompiledModel::Header) + sections_.size() * sizeof(CompiledModel::Entry);
+    for(auto &s : sections_) {
+      offset = align(offset);
+      entries.push_back(CompiledModel::Entry{s.first, 0, offset, s.second.size()});
+      offset += s.second.size();
+    }
+    std::string image(offset, '\0');
+    std::memcpy(&image[sizeof(CompiledModel::Header)], entries.data(), entries.size() * sizeof(CompiledModel::Entry));
+    for(size_t i = 0; i < sections_.size(); ++i) {
+      std::copy(sections_[i].second.begin(), sections_[i].second.end(), image.begin() + entries[i].offset);
+    }
+    CompiledModel::Header header{
+      CompiledModel::MAGIC, CompiledModel::VERSION, key_,
+      xxhash64(image.data() + sizeof(CompiledModel::Header), image.size() - sizeof(CompiledModel::Header)),
+      symbols_, uint32_t(sections_.size())
+    };
+    std::memcpy(&image[0], &header, sizeof(header));
+    return image;
+  }
+};
+
+} // namespace coding
+
+#endif /* end of include guard: CODINGMODEL_HPP */
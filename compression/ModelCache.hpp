@@ -0,0 +1,190 @@
+#ifndef CODINGMODELCACHE_HPP
+#define CODINGMODELCACHE_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <Base.hpp>
+#include <Arithmetic.hpp>
+#include <Huffman.hpp>
+#include <Interleaved.hpp>
+#include <Model.hpp>
+#include <Shannon.hpp>
+
+namespace coding {
+
+// a file mapped read-only, pages are read as they are touched
+class MappedFile {
+  const void *data_ = nullptr;
+  size_t size_ = 0;
+#ifdef _WIN32
+  HANDLE file_ = INVALID_HANDLE_VALUE;
+  HANDLE mapping_ = nullptr;
+#endif
+
+  void close() noexcept {
+#ifdef _WIN32
+    if(data_ != nullptr) {
+      UnmapViewOfFile(data_);
+    }
+    if(mapping_ != nullptr) {
+      CloseHandle(mapping_);
+    }
+    if(file_ != INVALID_HANDLE_VALUE) {
+      CloseHandle(file_);
+    }
+#else
+    if(data_ != nullptr) {
+      munmap(const_cast<void *>(data_), size_);
+    }
+#endif
+    data_ = nullptr;
+  }
+
+public:
+  explicit MappedFile(const std::string &path) {
+#ifdef _WIN32
+    file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    LARGE_INTEGER size;
+    if(file_ == INVALID_HANDLE_VALUE || !GetFileSizeEx(file_, &size) || size.QuadPart == 0) {
+      close();
+      throw std::runtime_error("unable to map " + path);
+    }
+    size_ = size.QuadPart;
+    mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    data_ = mapping_ ? MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if(data_ == nullptr) {
+      close();
+      throw std::runtime_error("unable to map " + path);
+    }
+#else
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if(fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+      if(fd >= 0) {
+        ::close(fd);
+      }
+      throw std::runtime_error("unable to map " + path);
+    }
+    size_ = st.st_size;
+    void *p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping outlives the descriptor
+    ::close(fd);
+    if(p == MAP_FAILED) {
+      throw std::runtime_error("unable to map " + path);
+    }
+    data_ = p;
+#endif
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  ~MappedFile() {
+    close();
+  }
+
+  const void *data() const noexcept {
+    return data_;
+  }
+
+  size_t size() const noexcept {
+    return size_;
+  }
+};
+
+// compiled models kept as files in a directory, one per alphabet and
+// probabilities, named by their key. a model that is there is mapped, and
+// codecs are loaded from it without rebuilding their tables; one that is
+// missing, of another version or damaged is compiled and written back.
+// the cache is an optimisation: when the directory cannot be written the
+// model lives in memory. safe to share between threads.
+class ModelCache {
+  std::string directory_;
+  std::mutex mutex_;
+  std::map<uint64_t, std::shared_ptr<const CompiledModel>> models_;
+
+public:
+  explicit ModelCache(std::string directory):
+    directory_(std::move(directory))
+  {}
+
+  // the tables of every codec that loads from a model
+  static std::string compile(const CodingMeta &meta) {
+    ModelImage image(meta);
+    Huffman(meta).save(image);
+    Shannon(meta).save(image);
+    Arithmetic(meta).save(image);
+    InterleavedHuffman(meta).save(image);
+    return image.bytes();
+  }
+
+  std::string path(uint64_t key) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.model", (unsigned long long)key);
+    return directory_.empty() ? std::string(name) : directory_ + "/" + name;
+  }
+
+  static std::shared_ptr<const CompiledModel> map(const std::string &path) {
+    auto file = std::make_shared<const MappedFile>(path);
+    return std::make_shared<const CompiledModel>(file->data(), file->size(), file);
+  }
+
+  std::shared_ptr<const CompiledModel> get(const CodingMeta &meta) {
+    const auto key = model_key(meta);
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = models_.find(key);
+    if(it != models_.end() && it->second->matches(meta)) {
+      return it->second;
+    }
+    const auto file = path(key);
+    std::shared_ptr<const CompiledModel> model;
+    try {
+      model = map(file);
+    } catch(std::runtime_error &) {
+      // missing, of another version or damaged
+    }
+    if(model == nullptr || !model->matches(meta)) {
+      auto image = std::make_shared<const std::string>(compile(meta));
+      model = std::make_shared<const CompiledModel>(image->data(), image->size(), image);
+      // written aside and renamed, a reader never maps half a file
+      const auto tmp = file + ".tmp";
+      std::ofstream out(tmp, std::ios::binary);
+      out.write(image->data(), image->size());
+      out.close();
+      if(out) {
+#ifdef _WIN32
+        // rename does not replace a file there
+        std::remove(file.c_str());
+#endif
+        std::rename(tmp.c_str(), file.c_str());
+      } else {
+        std::remove(tmp.c_str());
+      }
+    }
+    models_[key] = model;
+    return model;
+  }
+};
+
+} // namespace coding
+
+#endif /* end of include guard: CODINGMODELCACHE_HPP */
@@ -0,0 +1,247 @@
+#ifndef CODINGPIPELINE_HPP
+#define CODINGPIPELINE_HPP
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include <Base.hpp>
+#include <Trace.hpp>
+
+namespace coding {
+
+// symbols handed from stage to stage at a time, small enough that every
+// stage's output of a chunk stays in cache for the next one
+constexpr size_t PIPELINE_CHUNK_SIZE = size_t(1) << 14;
+
+namespace detail {
+
+template <typename... Stages>
+struct Chain;
+
+// the coder at the end of the chain
+template <typename Coder>
+struct Chain<Coder> {
+  Coder coder;
+  // a chunk that does not come as a string, reused
+  std::string chunk_;
+
+  template <typename... Args>
+  explicit Chain(const CodingMeta &meta, Args &&...args):
+    coder(meta, std::forward<Args>(args)...)
+  {}
+
+  void attach(Trace *trace) {
+    attach_trace(coder, trace);
+  }
+
+  size_t max_encoded_size(size_t n) const noexcept {
+    return coder.max_encoded_size(n);
+  }
+
+  double average_length() {
+    return coder.average_length();
+  }
+
+  void begin() {
+    coder.begin();
+  }
+
+  void push(const std::string &chunk, DynamicBitset &bset) {
+    coder.encode_more(chunk, bset);
+  }
+
+  void push(const char *text, size_t n, DynamicBitset &bset) {
+    chunk_.assign(text, n);
+    push(chunk_, bset);
+  }
+
+  void finish(DynamicBitset &bset) {
+    coder.finish(bset);
+  }
+
+  // the coders decode whole messages, the stages before get them by chunk
+  template <typename Sink>
+  void decode(const DynamicBitset &bset, Sink &&sink) {
+    const auto s = coder.decode(bset);
+    for(size_t from = 0; from < s.length(); from += PIPELINE_CHUNK_SIZE) {
+      sink(s.data() + from, std::min(PIPELINE_CHUNK_SIZE, s.length() - from));
+    }
+  }
+};
+
+template <typename Stage, typename Next, typename... Rest>
+struct Chain<Stage, Next, Rest...> {
+  const Stage stage;
+  typename Stage::State state_;
+  // the stage's output of one chunk, reused
+  std::string buffer_;
+  Chain<Next, Rest...> next;
+
+  // the rest is built on the model of the stage's output
+  template <typename... Args>
+  explicit Chain(const CodingMeta &meta, Args &&...args):
+    stage(meta),
+    next(*stage.output_meta, std::forward<Args>(args)...)
+  {}
+
+  void attach(Trace *trace) {
+    next.attach(trace);
+  }
+
+  size_t max_encoded_size(size_t n) const noexcept {
+    return next.max_encoded_size(stage.max_output_size(n));
+  }
+
+  double average_length() {
+    return stage.rate * next.average_length();
+  }
+
+  void begin() {
+    stage.begin(state_);
+    next.begin();
+  }
+
+  void push(const char *text, size_t n, DynamicBitset &bset) {
+    buffer_.clear();
+    stage.forward(state_, text, n, buffer_);
+    if(!buffer_.empty()) {
+      next.push(buffer_, bset);
+    }
+  }
+
+  void push(const std::string &chunk, DynamicBitset &bset) {
+    push(chunk.data(), chunk.length(), bset);
+  }
+
+  void finish(DynamicBitset &bset) {
+    buffer_.clear();
+    stage.finish(state_, buffer_);
+    if(!buffer_.empty()) {
+      next.push(buffer_, bset);
+    }
+    next.finish(bset);
+  }
+
+  template <typename Sink>
+  void decode(const DynamicBitset &bset, Sink &&sink) {
+    stage.begin(state_);
+    next.decode(bset, [&](const char *text, size_t n) {
+      buffer_.clear();
+      stage.inverse(state_, text, n, buffer_);
+      sink(buffer_.data(), buffer_.length());
+    });
+    buffer_.clear();
+    stage.finish_inverse(state_, buffer_);
+    sink(buffer_.data(), buffer_.length());
+  }
+};
+
+} // namespace detail
+
+// stages composed at compile time in front of a coder, e.g.
+// Pipeline<RunLengthStage, Huffman>, with the calls between them resolved
+// statically. encoding streams: the message goes through in chunks of
+// PIPELINE_CHUNK_SIZE, each stage writing into a buffer of its own that
+// is reused for every chunk, so no stage's output of the whole message is
+// held. decoding does not: the coder decodes the whole message into one
+// string and only the inverse stages run by chunk over it.
+//
+// a stage is immutable and keeps what spans chunks in its State: it is
+// built from the model of its input and has output_meta, the model of its
+// output, rate, the output symbols per input symbol that model expects,
+// max_output_size(n), begin(State &), forward and inverse(State &, text,
+// n, out), which append to out, and finish and finish_inverse(State &,
+// out). the coder has begin, encode_more and finish, as Huffman, LZ77,
+// LZW and Checked do; Arithmetic needs its terminator in the text, which
+// no stage writes. LZ77 and LZW write bits, not symbols, so they can end
+// a pipeline but not be a stage in it.
+template <typename... Stages>
+struct Pipeline {
+  // keeps a shared model alive, the first stage refers to it
+  std::shared_ptr<const CodingMeta> shared_meta;
+  detail::Chain<Stages...> chain;
+  // optional instrumentation, handed on to the coder; not to be shared
+  // between threads
+  Trace *trace = nullptr;
+
+  // extra arguments go to the coder
+  template <typename... Args>
+  explicit Pipeline(const CodingMeta &meta, Args &&...args):
+    chain(meta, std::forward<Args>(args)...)
+  {}
+
+  Pipeline(std::shared_ptr<const CodingMeta> meta):
+    Pipeline(*meta)
+  {
+    shared_meta = std::move(meta);
+  }
+
+  // bits of a message of n symbols at most
+  size_t max_encoded_size(size_t n) const noexcept {
+    return chain.max_encoded_size(n);
+  }
+
+  // bits per symbol the models expect
+  double average_length() {
+    return chain.average_length();
+  }
+
+  // a message given in pieces: begin, encode_more for every piece, then
+  // finish, which ends the message
+  void begin() {
+    chain.attach(trace);
+    chain.begin();
+  }
+
+  void encode_more(const std::string &text, DynamicBitset &bset) {
+    Trace::Timer timer(trace, "pipeline.encode");
+    for(size_t from = 0; from < text.length(); from += PIPELINE_CHUNK_SIZE) {
+      chain.push(text.data() + from, std::min(PIPELINE_CHUNK_SIZE, text.length() - from), bset);
+    }
+    if(trace) {
+      trace->count("pipeline.chunks", (text.length() + PIPELINE_CHUNK_SIZE - 1) / PIPELINE_CHUNK_SIZE);
+    }
+  }
+
+  void finish(DynamicBitset &bset) {
+    chain.finish(bset);
+  }
+
+  // into a reused buffer, returns the number of bits
+  size_t encode(const std::string &text, DynamicBitset &bset) {
+    bset.clear();
+    begin();
+    encode_more(text, bset);
+    finish(bset);
+    return bset.size();
+  }
+
+  DynamicBitset encode(const std::string &text) {
+    DynamicBitset bset;
+    encode(text, bset);
+    return bset;
+  }
+
+  // into a reused buffer, returns the number of symbols
+  size_t decode(const DynamicBitset &bset, std::string &s) {
+    Trace::Timer timer(trace, "pipeline.decode");
+    chain.attach(trace);
+    s.clear();
+    chain.decode(bset, [&s](const char *text, size_t n) {
+      s.append(text, n);
+    });
+    return s.length();
+  }
+
+  std::string decode(const DynamicBitset &bset) {
+    std::string s;
+    decode(bset, s);
+    return s;
+  }
+};
+
+} // namespace coding
+
+#endif /* end of include guard: CODINGPIPELINE_HPP */
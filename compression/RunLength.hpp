@@ -0,0 +1,272 @@
+#ifndef CODINGRUNLENGTH_HPP
+#define CODINGRUNLENGTH_HPP
+
+#include <cstdint>
+#include <array>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <Base.hpp>
+#include <Huffman.hpp>
+#include <Trace.hpp>
+
+namespace coding {
+
+// the run length transform for sources with one dominant symbol, which
+// no symbol code sends in less than a bit. runs of the model's most
+// probable symbol become their length in bijective base 2 with two
+// digits, as in the zero runs of BWT, and the other symbols pass through;
+// the stage symbols get a model derived from the source's, so a run of n
+// symbols reaches the coder as about log2 n digits.
+//
+// a stage of a Pipeline, and the front of RunLength. immutable, a run
+// that spans pieces of the text is held in the caller's State.
+//
+// stage symbols: RUNA and RUNB, then alphabet index + 2.
+struct RunLengthStage {
+  static constexpr int RUNA = 0, RUNB = 1;
+  // a run holds fewer than 2^MAX_DIGITS symbols
+  static constexpr int MAX_DIGITS = 40;
+  // the digits keep a code when the model leaves no room for runs
+  static constexpr double MIN_DIGIT_RATE = 1e-6;
+
+  // the run being counted or being read back from its digits
+  struct State {
+    uint64_t run = 0;
+    int digits = 0;
+    uint64_t runs = 0;
+  };
+
+  // keeps a shared model alive, meta refers to it
+  std::shared_ptr<const CodingMeta> shared_meta;
+  const CodingMeta &meta;
+  // alphabet index of the symbol whose runs are counted
+  const size_t dominant;
+  // the model of the stage symbols
+  const std::shared_ptr<const CodingMeta> output_meta;
+  // stage symbols per source symbol the model expects
+  const double rate;
+  // stage symbol of every byte, -1 outside of the alphabet
+  std::array<int16_t, 256> stage_index_;
+
+  RunLengthStage(const CodingMeta &meta):
+    meta(meta),
+    dominant(dominant_index(meta)),
+    output_meta(stage_model(meta, dominant)),
+    rate(1. - meta.get_prob(dominant) + digit_rate(meta.get_prob(dominant)))
+  {
+    stage_index_.fill(-1);
+    for(size_t i = 0; i < meta.size(); ++i) {
+      stage_index_[uint8_t(meta.get_char(i))] = i + 2;
+    }
+  }
+
+  RunLengthStage(std::shared_ptr<const CodingMeta> meta):
+    RunLengthStage(*meta)
+  {
+    shared_meta = std::move(meta);
+  }
+
+  static size_t dominant_index(const CodingMeta &meta) {
+    if(meta.size() == 0 || meta.size() > 254) {
+      throw std::domain_error("alphabet too large for the run length stage");
+    }
+    size_t best = 0;
+    for(size_t i = 1; i < meta.size(); ++i) {
+      if(meta.get_prob(i) > meta.get_prob(best)) {
+        best = i;
+      }
+    }
+    return best;
+  }
+
+  // digits per source symbol for i.i.d. symbols: runs start at rate
+  // p (1 - p), and a run of length L has floor(log2(L + 1)) digits, at
+  // least k of them with probability P(L >= 2^k - 1) = p^(2^k - 2)
+  static double digit_rate(double p) {
+    double digits = 0.;
+    for(int k = 1; k < 64; ++k) {
+      const double term = std::pow(p, std::ldexp(1., k) - 2.);
+      digits += term;
+      if(term < 1e-12) {
+        break;
+      }
+    }
+    return p * (1. - p) * digits;
+  }
+
+  static std::shared_ptr<const CodingMeta> stage_model(const CodingMeta &meta, size_t dominant) {
+    // a copy, std::max would bind the member to a reference
+    const double least = MIN_DIGIT_RATE;
+    const double digits = std::max(digit_rate(meta.get_prob(dominant)), least);
+    std::string alphabet;
+    std::vector<double> rates;
+    // the two digits share the runs alike
+    alphabet += char(RUNA), rates.push_back(digits / 2);
+    alphabet += char(RUNB), rates.push_back(digits / 2);
+    for(size_t i = 0; i < meta.size(); ++i) {
+      if(i != dominant) {
+        alphabet += char(i + 2), rates.push_back(meta.get_prob(i));
+      }
+    }
+    double sum = 0.;
+    for(auto r : rates) {
+      sum += r;
+    }
+    std::vector<float> probabilities;
+    for(auto r : rates) {
+      probabilities.push_back(r / sum);
+    }
+    return std::make_shared<const CodingMeta>(alphabet, probabilities);
+  }
+
+  // stage symbols of n source symbols at most: a run has no more digits
+  // than symbols
+  static size_t max_output_size(size_t n) noexcept {
+    return n;
+  }
+
+  void begin(State &st) const noexcept {
+    st = State();
+  }
+
+  // appends the stage symbols of n more source symbols, the last run is
+  // held back
+  void forward(State &st, const char *text, size_t n, std::string &out) const {
+    const int16_t dom = dominant + 2;
+    for(size_t i = 0; i < n; ++i) {
+      const auto x = stage_index_[uint8_t(text[i])];
+      if(x == dom) {
+        ++st.run;
+        continue;
+      }
+      if(x < 0) {
+        throw std::domain_error("symbol outside of the alphabet");
+      }
+      flush(st, out);
+      out += char(x);
+    }
+  }
+
+  void finish(State &st, std::string &out) const {
+    flush(st, out);
+  }
+
+  void flush(State &st, std::string &out) const {
+    st.runs += st.run > 0;
+    while(st.run > 0) {
+      const int digit = (st.run & 1) ? RUNA : RUNB;
+      out += char(digit);
+      st.run = (st.run - (digit + 1)) >> 1;
+    }
+  }
+
+  // appends the source symbols of n more stage symbols, a run is held
+  // back until a symbol ends it
+  void inverse(State &st, const char *stage, size_t n, std::string &out) const {
+    const char dom = meta.get_char(dominant);
+    for(size_t i = 0; i < n; ++i) {
+      const size_t x = uint8_t(stage[i]);
+      if(x == RUNA || x == RUNB) {
+        if(st.digits == MAX_DIGITS) {
+          throw std::domain_error("run too long");
+        }
+        st.run += (x + 1) << st.digits++;
+        continue;
+      }
+      out.append(st.run, dom);
+      st.run = 0, st.digits = 0;
+      if(x - 2 >= meta.size() || x - 2 == dominant) {
+        throw std::domain_error("symbol outside of the alphabet");
+      }
+      out += meta.get_char(x - 2);
+    }
+  }
+
+  void finish_inverse(State &st, std::string &out) const {
+    out.append(st.run, meta.get_char(dominant));
+    st.run = 0, st.digits = 0;
+  }
+};
+
+// run length stage in front of Coder (Huffman, Shannon or Block), the
+// whole message at once; Pipeline<RunLengthStage, Coder> streams it
+template <typename Coder = Huffman>
+struct RunLength {
+  // keeps a shared model alive, meta refers to it
+  std::shared_ptr<const CodingMeta> shared_meta;
+  const CodingMeta &meta;
+  const RunLengthStage stage;
+  Coder coder;
+  // optional instrumentation, not to be shared between threads; the
+  // stage coder has its own
+  Trace *trace = nullptr;
+
+  RunLength(const CodingMeta &meta):
+    meta(meta),
+    stage(meta),
+    coder(stage.output_meta)
+  {}
+
+  RunLength(std::shared_ptr<const CodingMeta> meta):
+    RunLength(*meta)
+  {
+    shared_meta = std::move(meta);
+  }
+
+  // bits of a message of n symbols at most
+  size_t max_encoded_size(size_t n) const noexcept {
+    return coder.max_encoded_size(RunLengthStage::max_output_size(n));
+  }
+
+  DynamicBitset encode(const std::string &text) const {
+    DynamicBitset bset;
+    encode(text, bset);
+    return bset;
+  }
+
+  // into a reused buffer, returns the number of bits
+  size_t encode(const std::string &text, DynamicBitset &bset) const {
+    Trace::Timer timer(trace, "runlength.encode");
+    RunLengthStage::State st;
+    std::string out;
+    out.reserve(text.length() * (1. - meta.get_prob(stage.dominant)) + 64);
+    stage.forward(st, text.data(), text.length(), out);
+    stage.finish(st, out);
+    coder.encode(out, bset);
+    if(trace) {
+      trace->count("runlength.runs", st.runs);
+      trace->count("runlength.stage_symbols", out.length());
+    }
+    return bset.size();
+  }
+
+  // bits per symbol the model expects
+  double average_length() const {
+    return coder.average_length() * stage.rate;
+  }
+
+  std::string decode(const DynamicBitset &bset) const {
+    std::string s;
+    decode(bset, s);
+    return s;
+  }
+
+  // into a reused buffer, returns the number of symbols
+  size_t decode(const DynamicBitset &bset, std::string &s) const {
+    Trace::Timer timer(trace, "runlength.decode");
+    const auto in = coder.decode(bset);
+    RunLengthStage::State st;
+    s.clear();
+    stage.inverse(st, in.data(), in.length(), s);
+    stage.finish_inverse(st, s);
+    return s.length();
+  }
+};
+
+} // namespace coding
+
+#endif /* end of include guard: CODINGRUNLENGTH_HPP */
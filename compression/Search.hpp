@@ -0,0 +1,266 @@
+#ifndef CODINGSEARCH_HPP
+#define CODINGSEARCH_HPP
+
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <Base.hpp>
+#include <BitIO.hpp>
+#include <LZ77.hpp>
+#include <LZW.hpp>
+#include <Universal.hpp>
+
+namespace coding {
+
+// finds a pattern in LZ77 and LZW code without decoding the message. the
+// pattern is compiled to a KMP automaton once and reused across streams.
+//
+// LZ77 symbols are fed to the automaton as the tokens are read, back
+// references are copied within a ring buffer the size of the window. LZW
+// phrases are not expanded at all: every phrase knows the state reached by
+// reading it from the start state and its last match from there, both
+// derived from its prefix phrase in constant time. only a phrase entered
+// in another state has its first pattern-length symbols read.
+class PatternSearch {
+  std::string pattern_;
+  // (length + 1) states of 256 transitions, the last state is a match
+  std::vector<int32_t> dfa_;
+
+  struct PhraseState {
+    uint64_t prefix;
+    uint64_t length;
+    // state after the phrase read from the start state
+    int32_t state;
+    char first;
+    char last;
+    // the phrase or its longest prefix that ends in a match from the start
+    // state, -1 if none
+    int64_t link;
+    // the prefix of the phrase that is one symbol shorter than the pattern,
+    // or the phrase itself if it is not longer
+    uint64_t head;
+  };
+
+  int32_t next(int32_t q, char c) const noexcept {
+    return dfa_[size_t(q) * 256 + uint8_t(c)];
+  }
+
+public:
+  explicit PatternSearch(const std::string &pattern):
+    pattern_(pattern)
+  {
+    if(pattern.empty()) {
+      throw std::invalid_argument("empty pattern");
+    }
+    const size_t m = pattern.length();
+    dfa_.assign((m + 1) * 256, 0);
+    dfa_[uint8_t(pattern[0])] = 1;
+    size_t x = 0;
+    for(size_t j = 1; j <= m; ++j) {
+      std::copy(dfa_.begin() + x * 256, dfa_.begin() + (x + 1) * 256, dfa_.begin() + j * 256);
+      if(j < m) {
+        dfa_[j * 256 + uint8_t(pattern[j])] = j + 1;
+        x = dfa_[x * 256 + uint8_t(pattern[j])];
+      }
+    }
+  }
+
+  const std::string &pattern() const noexcept {
+    return pattern_;
+  }
+
+  // offsets of all occurrences in a plain message, overlaps included
+  std::vector<uint64_t> find(const std::string &text) const {
+    std::vector<uint64_t> found;
+    const int32_t m = pattern_.length();
+    int32_t q = 0;
+    for(size_t i = 0; i < text.length(); ++i) {
+      q = next(q, text[i]);
+      if(q == m) {
+        found.push_back(i + 1 - m);
+      }
+    }
+    return found;
+  }
+
+  // the codec must hold the parameters of the message, as after encoding it
+  std::vector<uint64_t> find(const LZ77 &lz77, const DynamicBitset &bset) const {
+    std::vector<uint64_t> found;
+    const int32_t m = pattern_.length();
+    const int bits_sym = LZ77::ceil_log2(lz77.meta.size());
+    const int bits_distsize = LZ77::ceil_log2(lz77.window_size);
+    const int bits_lookahead = LZ77::ceil_log2(lz77.lookahead_size);
+    // distances take bits_distsize bits, the dictionary is in the window
+    const std::string dict = lz77.dictionary ? lz77.dictionary->content() : std::string();
+    size_t ring_size = 1;
+    while(ring_size <= (size_t(1) << bits_distsize) || ring_size < dict.length()) {
+      ring_size <<= 1;
+    }
+    const size_t mask = ring_size - 1;
+    std::vector<char> ring(ring_size);
+    uint64_t total = 0;
+    for(auto c : dict) {
+      ring[total++ & mask] = c;
+    }
+    const uint64_t dsize = total;
+    int32_t q = 0;
+    auto feed = [&](char c) {
+      ring[total++ & mask] = c;
+      q = next(q, c);
+      if(q == m) {
+        found.push_back(total - dsize - m);
+      }
+    };
+    if(lz77.tokens == LZ77::Tokens::Universal) {
+      LZ77::Decoder d;
+      auto tokens = lz77.read_tokens(d, bset, LZ77::Window{lz77.window_size, lz77.lookahead_size});
+      while(!tokens.done()) {
+        const auto t = tokens.next(total);
+        if(t.length) {
+          for(uint64_t k = 0; k < t.length; ++k) {
+            feed(ring[(total - t.distance) & mask]);
+          }
+        } else {
+          feed(lz77.meta.get_char(t.literal));
+        }
+      }
+      return found;
+    }
+    for(size_t i = 0; i < bset.size();) {
+      if(bset[i++]) {
+        if(i + bits_distsize + bits_lookahead > bset.size()) {
+          throw std::domain_error("truncated match");
+        }
+        const uint64_t distance = bset.get_bits(i, bits_distsize) + 1;
+        const uint64_t length = bset.get_bits(i + bits_distsize, bits_lookahead);
+        i += bits_distsize + bits_lookahead;
+        if(distance > total) {
+          throw std::domain_error("match out of range");
+        }
+        for(uint64_t k = 0; k < length; ++k) {
+          feed(ring[(total - distance) & mask]);
+        }
+      } else {
+        if(i + bits_sym > bset.size()) {
+          throw std::domain_error("truncated literal");
+        }
+        const auto ind = bset.get_bits(i, bits_sym);
+        i += bits_sym;
+        if(ind >= lz77.meta.size()) {
+          throw std::domain_error("symbol outside of the alphabet");
+        }
+        feed(lz77.meta.get_char(ind));
+      }
+    }
+    return found;
+  }
+
+  std::vector<uint64_t> find(const LZW &lzw, const DynamicBitset &bset) const {
+    std::vector<uint64_t> found;
+    if(bset.size() == 0) {
+      return found;
+    }
+    const int width = lzw.block_size;
+    if(width <= 0) {
+      throw std::domain_error("code width unknown");
+    }
+    const int32_t m = pattern_.length();
+    std::vector<PhraseState> phrases;
+    phrases.reserve((lzw.dictionary ? lzw.dictionary->lzw_size() : lzw.meta.size()) + bset.size() / width + 1);
+    auto add_root = [&](char c) {
+      const int64_t z = phrases.size();
+      const auto q = next(0, c);
+      phrases.push_back(PhraseState{0, 1, q, c, c, q == m ? z : -1, uint64_t(z)});
+    };
+    // the phrase w + c
+    auto add = [&](uint64_t w, char c) {
+      const int64_t z = phrases.size();
+      const PhraseState p = phrases[w];
+      const auto q = next(p.state, c);
+      const auto length = p.length + 1;
+      phrases.push_back(PhraseState{w, length, q, p.first, c, q == m ? z : p.link, length < uint64_t(m) ? z : p.head});
+    };
+    if(lzw.dictionary) {
+      const Phrase *shared = lzw.dictionary->lzw_phrases();
+      for(uint64_t x = 0; x < lzw.dictionary->lzw_size(); ++x) {
+        if(shared[x].length == 1) {
+          add_root(shared[x].last);
+        } else {
+          add(shared[x].prefix, shared[x].last);
+        }
+      }
+    } else {
+      for(size_t i = 0; i < lzw.meta.size(); ++i) {
+        add_root(lzw.meta.get_char(i));
+      }
+    }
+    std::vector<char> head(m);
+    std::vector<uint64_t> inside;
+    uint64_t pos = 0;
+    int32_t q = 0;
+    auto read = [&](uint64_t x) {
+      const auto &p = phrases[x];
+      if(q != 0 && m > 1) {
+        // matches that start before the phrase end in its head
+        const uint64_t k = phrases[p.head].length;
+        uint64_t y = p.head;
+        for(uint64_t i = k; i > 0; --i) {
+          head[i - 1] = phrases[y].last;
+          y = phrases[y].prefix;
+        }
+        for(uint64_t i = 0; i < k; ++i) {
+          q = next(q, head[i]);
+          if(q == m) {
+            found.push_back(pos + i + 1 - m);
+          }
+        }
+        if(p.length == k) {
+          pos += k;
+          return;
+        }
+      }
+      // the rest is as if read from the start state
+      inside.clear();
+      for(int64_t y = p.link; y != -1; y = phrases[y].length == 1 ? -1 : phrases[phrases[y].prefix].link) {
+        inside.push_back(pos + phrases[y].length - m);
+      }
+      found.insert(found.end(), inside.rbegin(), inside.rend());
+      q = p.state;
+      pos += p.length;
+    };
+    uint64_t w = 0;
+    for(size_t i = 0; i < bset.size(); i += width) {
+      if(i + width > bset.size()) {
+        throw std::domain_error("truncated code");
+      }
+      const auto x = bset.get_bits(i, width);
+      if(i == 0) {
+        if(x >= phrases.size()) {
+          throw std::domain_error("code out of range");
+        }
+        read(x);
+        w = x;
+        continue;
+      }
+      char c;
+      if(x < phrases.size()) {
+        c = phrases[x].first;
+      } else if(x == phrases.size()) {
+        c = phrases[w].first;
+      } else {
+        throw std::domain_error("code out of range");
+      }
+      add(w, c);
+      read(x);
+      w = x;
+    }
+    return found;
+  }
+};
+
+} // namespace coding
+
+#endif /* end of include guard: CODINGSEARCH_HPP */
@@ -0,0 +1,154 @@
+#ifndef CODINGSEEKABLE_HPP
+#define CODINGSEEKABLE_HPP
+
+#include <cstdint>
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <Base.hpp>
+#include <Auto.hpp>
+#include <Trace.hpp>
+
+namespace coding {
+
+// blocks coded independently behind a seek table, so that a range of the
+// message is decoded from the blocks that cover it and nothing else. the
+// coder must decode a block from its bits alone, like Base, Auto or
+// LongRangeLZ77.
+//
+// layout: block size, message length, the end of every block's code
+// relative to the first block in OFFSET_BITS each, then the blocks. the
+// table entries have a fixed width, so finding a block costs one read.
+template <typename Coder = Auto>
+struct Seekable {
+  static constexpr int BLOCK_BITS = 32;
+  static constexpr int OFFSET_BITS = 40;
+  static constexpr size_t DEFAULT_BLOCK_SIZE = 1 << 16;
+
+  // keeps a shared model alive, meta refers to it
+  std::shared_ptr<const CodingMeta> shared_meta;
+  const CodingMeta &meta;
+  const size_t block_size;
+  Coder coder;
+  double avglen = 0.;
+  // optional instrumentation
+  Trace *trace = nullptr;
+
+  Seekable(const CodingMeta &meta, size_t block_size = DEFAULT_BLOCK_SIZE):
+    meta(meta),
+    block_size(block_size),
+    coder(meta)
+  {
+    if(block_size == 0 || (uint64_t(block_size) >> BLOCK_BITS)) {
+      throw std::runtime_error("block size out of range");
+    }
+  }
+
+  Seekable(std::shared_ptr<const CodingMeta> meta, size_t block_size = DEFAULT_BLOCK_SIZE):
+    Seekable(*meta, block_size)
+  {
+    shared_meta = std::move(meta);
+  }
+
+  static void put(DynamicBitset &bset, uint64_t x, int bits) {
+    for(int i = bits - 1; i >= 0; --i) {
+      bset.append_bit((x >> i) & 1);
+    }
+  }
+
+  DynamicBitset encode(const std::string &text) {
+    Trace::Timer timer(trace, "seekable.encode");
+    attach_trace(coder, trace);
+    const size_t nblocks = (text.length() + block_size - 1) / block_size;
+    DynamicBitset blocks;
+    std::vector<uint64_t> ends;
+    ends.reserve(nblocks);
+    for(size_t from = 0; from < text.length(); from += block_size) {
+      auto code = coder.encode(text.substr(from, block_size));
+      blocks.append(code);
+      ends.push_back(blocks.size());
+    }
+    if(blocks.size() >> OFFSET_BITS) {
+      throw std::length_error("message too long for the seek table");
+    }
+    DynamicBitset bset;
+    put(bset, block_size, BLOCK_BITS);
+    put(bset, text.length(), OFFSET_BITS);
+    for(auto end : ends) {
+      put(bset, end, OFFSET_BITS);
+    }
+    bset.append(blocks);
+    avglen = text.empty() ? 0. : double(bset.size()) / text.length();
+    return bset;
+  }
+
+  // bits per symbol of the last message, seek table included
+  double average_length() {
+    return avglen;
+  }
+
+  // length of the message, read from the header
+  static uint64_t length(const DynamicBitset &bset) {
+    if(bset.size() < BLOCK_BITS + OFFSET_BITS) {
+      throw std::domain_error("truncated seek table");
+    }
+    return bset.get_bits(BLOCK_BITS, OFFSET_BITS);
+  }
+
+  // symbols [offset, offset + length) of the message, clipped at its end
+  std::string decode_range(const DynamicBitset &bset, uint64_t offset, uint64_t length) {
+    Trace::Timer timer(trace, "seekable.decode_range");
+    attach_trace(coder, trace);
+    const uint64_t total = Seekable::length(bset);
+    const uint64_t bsize = bset.get_bits(0, BLOCK_BITS);
+    if(bsize == 0) {
+      throw std::domain_error("invalid block size");
+    }
+    if(offset > total) {
+      throw std::out_of_range("offset past the end of the message");
+    }
+    length = std::min(length, total - offset);
+    if(length == 0) {
+      return std::string();
+    }
+    const uint64_t nblocks = (total + bsize - 1) / bsize;
+    const size_t table = BLOCK_BITS + OFFSET_BITS;
+    const size_t data = table + nblocks * OFFSET_BITS;
+    if(data > bset.size()) {
+      throw std::domain_error("truncated seek table");
+    }
+    auto block_end = [&](uint64_t b) -> uint64_t {
+      return b == 0 ? 0 : bset.get_bits(table + (b - 1) * OFFSET_BITS, OFFSET_BITS);
+    };
+    const uint64_t first = offset / bsize, last = (offset + length - 1) / bsize;
+    std::string s;
+    for(uint64_t b = first; b <= last; ++b) {
+      const uint64_t from = block_end(b), to = block_end(b + 1);
+      if(from > to || data + to > bset.size()) {
+        throw std::domain_error("truncated block");
+      }
+      auto block = coder.decode(bset.slice(data + from, to - from));
+      if(block.length() != std::min(bsize, total - b * bsize)) {
+        throw std::domain_error("unable to fully decode the text");
+      }
+      s += block;
+    }
+    if(trace) {
+      trace->count("seekable.blocks_decoded", last - first + 1);
+    }
+    return s.substr(offset - first * bsize, length);
+  }
+
+  std::string decode(const DynamicBitset &bset) {
+    if(bset.size() == 0) {
+      return std::string();
+    }
+    return decode_range(bset, 0, length(bset));
+  }
+};
+
+} // namespace coding
+
+#endif /* end of include guard: CODINGSEEKABLE_HPP */
@@ -1,7 +1,12 @@
  #ifndef CODINGSHANNON_HPP
  #define CODINGSHANNON_HPP
 
+#include <array>
+#include <memory>
+#include <vector>
+
 #include <Base.hpp>
+#include <Model.hpp>
 
 namespace coding {
 
@@ -9,12 +14,34 @@ namespace detail {
 
 } // namespace detail
 
+// the code is built with the codec, which is immutable from then on
 struct Shannon {
+  // keeps a shared model alive, meta refers to it
+  std::shared_ptr<const CodingMeta> shared_meta;
   const CodingMeta &meta;
+  // the alphabet and probabilities sorted by probability, and their codes
+  std::string symbols;
+  std::vector<float> sorted_probs;
+  std::vector<DynamicBitset> dict;
 
   Shannon(const CodingMeta &meta):
     meta(meta)
-  {}
+  {
+    build();
+  }
+
+  Shannon(std::shared_ptr<const CodingMeta> meta):
+    Shannon(*meta)
+  {
+    shared_meta = std::move(meta);
+  }
+
+  // the code of a compiled model, copied
+  Shannon(const CodingMeta &meta, const CompiledModel &model):
+    meta(meta)
+  {
+    load(model);
+  }
 
   template <typename T>
   static void swap(T &x, T &y) {
@@ -34,10 +61,7 @@ struct Shannon {
     }
   }
 
-  std::vector<DynamicBitset> dict;
-
-  DynamicBitset encode(const std::string &text) {
-    DynamicBitset bset;
+  void build() {
     auto len = meta.size();
     auto alph = meta.alphabet();
     auto probs = meta.probabilities();
@@ -61,34 +85,111 @@ struct Shannon {
         dict[i].append_bit(x & (uint32_t(1) << (L - j - 1)));
       }
     }
-    // encode text
-    for(auto c : text) {
-      bset.append(dict[alph.find(c)]);
+    symbols = alph;
+    sorted_probs = probs;
+  }
+
+  void save(ModelImage &image) const {
+    const size_t len = meta.size();
+    std::vector<uint32_t> order(len), lengths(len);
+    std::vector<uint8_t> bits;
+    for(size_t i = 0; i < len; ++i) {
+      order[i] = meta.find_char(symbols[i]);
+      lengths[i] = dict[i].size();
+      for(size_t j = 0; j < dict[i].size(); ++j) {
+        bits.push_back(dict[i][j]);
+      }
+    }
+    image.add(CompiledModel::SHANNON_ORDER, order);
+    image.add(CompiledModel::SHANNON_CODE_LENGTHS, lengths);
+    image.add(CompiledModel::SHANNON_CODE_BITS, bits);
+  }
+
+  // what build() makes, from a compiled model
+  void load(const CompiledModel &model) {
+    if(!model.matches(meta)) {
+      throw std::runtime_error("the compiled model is of another alphabet or probabilities");
     }
+    const size_t len = meta.size();
+    auto order = model.section<uint32_t>(CompiledModel::SHANNON_ORDER, len);
+    auto lengths = model.section<uint32_t>(CompiledModel::SHANNON_CODE_LENGTHS, len);
+    size_t total = 0;
+    for(size_t i = 0; i < len; ++i) {
+      if(order[i] >= len) {
+        throw std::runtime_error("corrupt compiled model");
+      }
+      total += lengths[i];
+    }
+    auto bits = model.section<uint8_t>(CompiledModel::SHANNON_CODE_BITS, total);
+    symbols.clear();
+    sorted_probs.clear();
+    dict.assign(len, DynamicBitset());
+    for(size_t i = 0, pos = 0; i < len; ++i) {
+      symbols += meta.get_char(order[i]);
+      sorted_probs.push_back(meta.get_prob(order[i]));
+      for(size_t j = 0; j < lengths[i]; ++j) {
+        dict[i].append_bit(bits[pos++]);
+      }
+    }
+  }
+
+  // bits of a message of n symbols at most
+  size_t max_encoded_size(size_t n) const noexcept {
+    size_t longest = 0;
+    for(auto &code : dict) {
+      longest = std::max(longest, code.size());
+    }
+    return n * longest;
+  }
+
+  // length of the code of the symbol at alphabet index x
+  size_t code_length(size_t x) const {
+    return dict[symbols.find(meta.get_char(x))].size();
+  }
+
+  DynamicBitset encode(const std::string &text) const {
+    DynamicBitset bset;
+    encode(text, bset);
     return bset;
   }
 
-  double average_length() {
-    auto a = meta.alphabet();
-    auto p = meta.probabilities();
-    sort(p, a);
+  // into a reused buffer, returns the number of bits
+  size_t encode(const std::string &text, DynamicBitset &bset) const {
+    bset.clear();
+    for(auto c : text) {
+      const auto i = symbols.find(c);
+      if(i == std::string::npos) {
+        throw std::domain_error("symbol outside of the alphabet");
+      }
+      bset.append(dict[i]);
+    }
+    return bset.size();
+  }
 
+  double average_length() const {
     double avglen = 0;
     for(int i = 0; i < meta.size(); ++i) {
-      avglen += p[i] * dict[i].size();
+      avglen += sorted_probs[i] * dict[i].size();
     }
     return avglen;
   }
 
-  std::string decode(const DynamicBitset &bset) {
+  std::string decode(const DynamicBitset &bset) const {
     std::string s;
+    decode(bset, s);
+    return s;
+  }
+
+  // into a reused buffer, returns the number of symbols
+  size_t decode(const DynamicBitset &bset, std::string &s) const {
+    s.clear();
     auto len = meta.size();
-    auto alph = meta.alphabet();
-    auto probs = meta.probabilities();
-    sort(probs, alph);
+    const auto &alph = symbols;
     // decoding
     int counter = len;
-    std::vector<bool> states(len, 1);
+    // a byte alphabet has at most 256 symbols, no need to allocate
+    std::array<bool, 256> states;
+    states.fill(1);
     for(int i = 0, j = 0; i < bset.size(); ++i, ++j) {
       for(int k = 0; k < len; ++k) {
         if(counter == 0) {
@@ -118,7 +219,7 @@ struct Shannon {
         }
       }
     }
-    return s;
+    return s.length();
   }
 };
 
@@ -0,0 +1,214 @@
+#ifndef CODINGSTATICHUFFMAN_HPP
+#define CODINGSTATICHUFFMAN_HPP
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#include <utility>
+
+#include <Huffman.hpp>
+
+namespace coding {
+
+template <char... Cs> struct symbols {};
+template <unsigned... Fs> struct frequencies {};
+
+namespace detail {
+
+// canonical huffman code over N symbols, computed at compile time
+template <size_t N>
+struct static_huffman_table {
+  char symbols[N];
+  uint64_t freqs[N];
+  int lengths[N];
+  uint64_t codes[N];
+  int max_length;
+};
+
+template <size_t N>
+constexpr static_huffman_table<N> make_static_huffman_table(const char (&a)[N], const unsigned (&f)[N]) {
+  static_huffman_table<N> t = {};
+  // merge the two lightest trees N-1 times, ties go to the lower index
+  uint64_t weight[2 * N - 1] = {};
+  int parent[2 * N - 1] = {};
+  bool alive[2 * N - 1] = {};
+  for(size_t i = 0; i < N; ++i) {
+    t.symbols[i] = a[i];
+    t.freqs[i] = f[i];
+    weight[i] = f[i];
+    alive[i] = true;
+  }
+  for(size_t i = 0; i < 2 * N - 1; ++i) {
+    parent[i] = -1;
+  }
+  for(size_t k = N; k < 2 * N - 1; ++k) {
+    int x = -1, y = -1;
+    for(size_t i = 0; i < k; ++i) {
+      if(!alive[i]) continue;
+      if(x == -1 || weight[i] < weight[x]) {
+        y = x, x = i;
+      } else if(y == -1 || weight[i] < weight[y]) {
+        y = i;
+      }
+    }
+    weight[k] = weight[x] + weight[y];
+    alive[k] = true;
+    alive[x] = alive[y] = false;
+    parent[x] = parent[y] = k;
+  }
+  // code lengths are leaf depths, a lone symbol still takes one bit
+  t.max_length = 0;
+  for(size_t i = 0; i < N; ++i) {
+    int len = 0;
+    for(int n = i; parent[n] != -1; n = parent[n]) {
+      ++len;
+    }
+    t.lengths[i] = (len == 0) ? 1 : len;
+    if(t.lengths[i] > t.max_length) {
+      t.max_length = t.lengths[i];
+    }
+  }
+  // canonical codes: by length, then by position in the alphabet
+  uint64_t code = 0;
+  for(int len = 1; len <= t.max_length; ++len) {
+    for(size_t i = 0; i < N; ++i) {
+      if(t.lengths[i] == len) {
+        t.codes[i] = code++;
+      }
+    }
+    code <<= 1;
+  }
+  return t;
+}
+
+// entries pack the symbol index above the code length
+template <size_t N, int L>
+struct static_huffman_decode_table {
+  static constexpr int LENGTH_BITS = 6;
+  uint32_t entries[size_t(1) << L];
+};
+
+template <size_t N, int L>
+constexpr static_huffman_decode_table<N, L> make_static_huffman_decode_table(const static_huffman_table<N> &t) {
+  static_huffman_decode_table<N, L> d = {};
+  for(size_t i = 0; i < N; ++i) {
+    const int shift = L - t.lengths[i];
+    for(uint64_t j = t.codes[i] << shift; j < (t.codes[i] + 1) << shift; ++j) {
+      d.entries[j] = uint32_t(i << d.LENGTH_BITS) | uint32_t(t.lengths[i]);
+    }
+  }
+  return d;
+}
+
+// per-byte code and length, zero length for bytes outside the alphabet
+struct static_huffman_byte_table {
+  uint64_t codes[256];
+  int lengths[256];
+};
+
+template <size_t N>
+constexpr int static_huffman_find(const static_huffman_table<N> &t, unsigned char c) {
+  for(size_t i = 0; i < N; ++i) {
+    if((unsigned char)(t.symbols[i]) == c) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+template <size_t N, size_t... Is>
+constexpr static_huffman_byte_table make_static_huffman_byte_table(const static_huffman_table<N> &t, std::index_sequence<Is...>) {
+  return static_huffman_byte_table{
+    { (static_huffman_find(t, Is) == -1 ? 0 : t.codes[static_huffman_find(t, Is)])... },
+    { (static_huffman_find(t, Is) == -1 ? 0 : t.lengths[static_huffman_find(t, Is)])... }
+  };
+}
+
+} // namespace detail
+
+// huffman code for a distribution fixed at compile time: both the code and
+// the decoding tables are constant data, nothing is built at runtime
+//
+//   using code = StaticHuffman<symbols<'a', 'b', 'c'>, frequencies<5, 3, 2>>;
+//   auto bset = code::encode("abacab");
+template <typename Alphabet, typename Frequencies> struct StaticHuffman;
+
+template <char... Cs, unsigned... Fs>
+struct StaticHuffman<symbols<Cs...>, frequencies<Fs...>> {
+  static constexpr size_t N = sizeof...(Cs);
+  static_assert(N > 0, "empty alphabet");
+  static_assert(N == sizeof...(Fs), "alphabet length must match the number of frequencies");
+
+  // longest code that still gets a flat decoding table
+  static constexpr int MAX_TABLE_BITS = 16;
+
+  using table_t = detail::static_huffman_table<N>;
+  static constexpr table_t table = detail::make_static_huffman_table<N>({Cs...}, {Fs...});
+
+  static constexpr int max_length = table.max_length;
+  static_assert(max_length <= MAX_TABLE_BITS, "distribution too skewed for a flat decoding table");
+  static_assert(Huffman::ceil_log2(N) + detail::static_huffman_decode_table<N, max_length>::LENGTH_BITS <= 32,
+                "decoding table entries overflow");
+
+  using decode_table_t = detail::static_huffman_decode_table<N, max_length>;
+  static constexpr decode_table_t decode_table = detail::make_static_huffman_decode_table<N, max_length>(table);
+
+  using byte_table_t = detail::static_huffman_byte_table;
+  static constexpr byte_table_t byte_table = detail::make_static_huffman_byte_table<N>(table, std::make_index_sequence<256>());
+
+  static constexpr double average_length() {
+    uint64_t total = 0, bits = 0;
+    for(size_t i = 0; i < N; ++i) {
+      total += table.freqs[i];
+      bits += table.freqs[i] * table.lengths[i];
+    }
+    return total ? double(bits) / total : 0.;
+  }
+
+  static DynamicBitset encode(const std::string &text) {
+    DynamicBitset bset;
+    for(auto c : text) {
+      const auto code = byte_table.codes[uint8_t(c)];
+      const int len = byte_table.lengths[uint8_t(c)];
+      if(len == 0) {
+        throw std::domain_error("symbol outside of the alphabet");
+      }
+      for(int i = len - 1; i >= 0; --i) {
+        bset.append_bit((code >> i) & 1);
+      }
+    }
+    return bset;
+  }
+
+  static std::string decode(const DynamicBitset &bset) {
+    std::string s;
+    for(size_t i = 0; i < bset.size();) {
+      const auto entry = decode_table.entries[bset.get_bits(i, max_length)];
+      const int len = entry & ((1 << decode_table_t::LENGTH_BITS) - 1);
+      // no code starts with these bits
+      if(len == 0 || i + len > bset.size()) {
+        throw std::domain_error("unable to fully decode the text");
+      }
+      s += table.symbols[entry >> decode_table_t::LENGTH_BITS];
+      i += len;
+    }
+    return s;
+  }
+};
+
+template <char... Cs, unsigned... Fs>
+constexpr typename StaticHuffman<symbols<Cs...>, frequencies<Fs...>>::table_t
+StaticHuffman<symbols<Cs...>, frequencies<Fs...>>::table;
+
+template <char... Cs, unsigned... Fs>
+constexpr typename StaticHuffman<symbols<Cs...>, frequencies<Fs...>>::decode_table_t
+StaticHuffman<symbols<Cs...>, frequencies<Fs...>>::decode_table;
+
+template <char... Cs, unsigned... Fs>
+constexpr typename StaticHuffman<symbols<Cs...>, frequencies<Fs...>>::byte_table_t
+StaticHuffman<symbols<Cs...>, frequencies<Fs...>>::byte_table;
+
+} // namespace coding
+
+#endif /* end of include guard: CODINGSTATICHUFFMAN_HPP */
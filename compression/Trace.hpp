@@ -0,0 +1,226 @@
+#ifndef CODINGTRACE_HPP
+#define CODINGTRACE_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace coding {
+
+// opt-in codec instrumentation: counters, peaks, histograms, time series
+// and wall-clock spans. codecs hold a Trace pointer that is null unless
+// the caller sets it, so a disabled probe is one branch; hot loops count
+// into locals and report once per call. a trace belongs to one thread.
+class Trace {
+public:
+  using clock = std::chrono::steady_clock;
+
+  struct Span {
+    std::string name;
+    double start_us;
+    double duration_us;
+  };
+
+  struct Sample {
+    std::string name;
+    double time_us;
+    double value;
+  };
+
+  // wall-clock span from construction to destruction, no-op without a trace
+  class Timer {
+    Trace *trace_;
+    const char *name_;
+    double start_us_;
+  public:
+    Timer(Trace *trace, const char *name):
+      trace_(trace), name_(name), start_us_(trace ? trace->now_us() : 0.)
+    {}
+    Timer(const Timer &) = delete;
+    Timer &operator=(const Timer &) = delete;
+    ~Timer() {
+      stop();
+    }
+    // ends the span early
+    void stop() {
+      if(trace_) {
+        trace_->span(name_, start_us_, trace_->now_us());
+        trace_ = nullptr;
+      }
+    }
+  };
+
+private:
+  clock::time_point origin_;
+  std::map<std::string, uint64_t> counters_;
+  std::map<std::string, uint64_t> peaks_;
+  std::map<std::string, std::map<uint64_t, uint64_t>> histograms_;
+  std::vector<Span> spans_;
+  std::vector<Sample> samples_;
+
+  static std::string quote(const std::string &s) {
+    std::string q = "\"";
+    for(auto c : s) {
+      if(c == '"' || c == '\\') {
+        q += '\\';
+        q += c;
+      } else if(uint8_t(c) < 0x20) {
+        char buf[8];
+        std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+        q += buf;
+      } else {
+        q += c;
+      }
+    }
+    return q + "\"";
+  }
+
+  static std::string number(double x) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.3f", x);
+    return buf;
+  }
+
+  template <typename Map, typename F>
+  static std::string object(const Map &m, F value) {
+    std::string s = "{";
+    for(auto it = m.begin(); it != m.end(); ++it) {
+      s += (it == m.begin() ? "" : ",") + quote(it->first) + ":" + value(it->second);
+    }
+    return s + "}";
+  }
+
+public:
+  Trace():
+    origin_(clock::now())
+  {}
+
+  // microseconds since the trace was created
+  double now_us() const {
+    return std::chrono::duration<double, std::micro>(clock::now() - origin_).count();
+  }
+
+  void count(const std::string &name, uint64_t n = 1) {
+    counters_[name] += n;
+  }
+
+  void peak(const std::string &name, uint64_t value) {
+    auto &p = peaks_[name];
+    p = std::max(p, value);
+  }
+
+  // one more occurrence of value in the named histogram
+  void record(const std::string &name, uint64_t value, uint64_t n = 1) {
+    histograms_[name][value] += n;
+  }
+
+  // a value that changes over time, e.g. the size of a dictionary
+  void sample(const std::string &name, double value) {
+    samples_.push_back(Sample{name, now_us(), value});
+  }
+
+  void span(const std::string &name, double start_us, double end_us) {
+    spans_.push_back(Span{name, start_us, end_us - start_us});
+  }
+
+  const std::map<std::string, uint64_t> &counters() const noexcept { return counters_; }
+  const std::map<std::string, uint64_t> &peaks() const noexcept { return peaks_; }
+  const std::map<std::string, std::map<uint64_t, uint64_t>> &histograms() const noexcept { return histograms_; }
+  const std::vector<Span> &spans() const noexcept { return spans_; }
+  const std::vector<Sample> &samples() const noexcept { return samples_; }
+
+  std::string to_json() const {
+    auto integer = [](uint64_t x) { return std::to_string(x); };
+    std::string s = "{\"counters\":" + object(counters_, integer);
+    s += ",\"peaks\":" + object(peaks_, integer);
+    s += ",\"histograms\":" + object(histograms_, [&](const std::map<uint64_t, uint64_t> &h) {
+      std::string o = "{";
+      for(auto it = h.begin(); it != h.end(); ++it) {
+        o += (it == h.begin() ? "" : ",") + quote(std::to_string(it->first)) + ":" + std::to_string(it->second);
+      }
+      return o + "}";
+    });
+    s += ",\"spans\":[";
+    for(size_t i = 0; i < spans_.size(); ++i) {
+      s += (i ? "," : "") + std::string("{\"name\":") + quote(spans_[i].name)
+        + ",\"start_us\":" + number(spans_[i].start_us)
+        + ",\"duration_us\":" + number(spans_[i].duration_us) + "}";
+    }
+    s += "],\"samples\":[";
+    for(size_t i = 0; i < samples_.size(); ++i) {
+      s += (i ? "," : "") + std::string("{\"name\":") + quote(samples_[i].name)
+        + ",\"time_us\":" + number(samples_[i].time_us)
+        + ",\"value\":" + number(samples_[i].value) + "}";
+    }
+    return s + "]}";
+  }
+
+  // chrome://tracing and Perfetto: spans as complete events, samples as
+  // counter tracks, the totals as metadata
+  std::string to_chrome_trace() const {
+    std::string s = "{\"traceEvents\":[";
+    bool first = true;
+    auto event = [&](const std::string &e) {
+      s += (first ? "" : ",") + e;
+      first = false;
+    };
+    for(auto &sp : spans_) {
+      event("{\"name\":" + quote(sp.name) + ",\"cat\":\"codec\",\"ph\":\"X\",\"pid\":1,\"tid\":1"
+            + ",\"ts\":" + number(sp.start_us) + ",\"dur\":" + number(sp.duration_us) + "}");
+    }
+    for(auto &sm : samples_) {
+      event("{\"name\":" + quote(sm.name) + ",\"ph\":\"C\",\"pid\":1,\"tid\":1"
+            + ",\"ts\":" + number(sm.time_us) + ",\"args\":{\"value\":" + number(sm.value) + "}}");
+    }
+    s += "],\"displayTimeUnit\":\"ms\",\"otherData\":" + to_json() + "}";
+    return s;
+  }
+
+  // plain text, one line per counter, peak and span
+  std::string summary() const {
+    std::string s;
+    for(auto &c : counters_) {
+      s += c.first + ": " + std::to_string(c.second) + "\n";
+    }
+    for(auto &p : peaks_) {
+      s += p.first + " (peak): " + std::to_string(p.second) + "\n";
+    }
+    for(auto &h : histograms_) {
+      uint64_t n = 0, sum = 0;
+      for(auto &b : h.second) {
+        n += b.second, sum += b.first * b.second;
+      }
+      s += h.first + " (mean): " + number(n ? double(sum) / n : 0.) + "\n";
+    }
+    for(auto &sp : spans_) {
+      s += sp.name + ": " + number(sp.duration_us / 1000.) + " ms\n";
+    }
+    return s;
+  }
+};
+
+namespace detail {
+
+template <typename Coder>
+auto attach_trace(Coder &coder, Trace *trace, int) -> decltype(coder.trace = trace, void()) {
+  coder.trace = trace;
+}
+
+template <typename Coder>
+void attach_trace(Coder &, Trace *, long) {}
+
+} // namespace detail
+
+// points the probes of a codec at a trace, codecs without probes are left alone
+template <typename Coder>
+void attach_trace(Coder &coder, Trace *trace) {
+  detail::attach_trace(coder, trace, 0);
+}
+
+} // namespace coding
+
+#endif /* end of include guard: CODINGTRACE_HPP */
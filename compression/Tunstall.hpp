@@ -0,0 +1,227 @@
+#ifndef CODINGTUNSTALL_HPP
+#define CODINGTUNSTALL_HPP
+
+#include <cstdint>
+#include <algorithm>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <Base.hpp>
+#include <Trace.hpp>
+
+namespace coding {
+
+// variable-to-fixed code: the message is parsed into phrases of a
+// dictionary of at most 2^bits, each sent as its bits-wide index. the
+// dictionary is the tunstall tree of the model, grown by splitting its
+// most probable phrase into one phrase per symbol for as long as the
+// leaves fit, so probable runs take one codeword. decoding is a copy of
+// the phrase per codeword, and a codeword's place in the stream is known
+// without reading the ones before it.
+//
+// layout: the message length in LENGTH_BITS, then the codewords. a
+// message that ends inside a phrase is padded to one and cut to length.
+struct Tunstall {
+  static constexpr int DEFAULT_BITS = 12;
+  static constexpr int MAX_BITS = 24;
+  static constexpr int LENGTH_BITS = 40;
+  // phrases are not split any further, a single symbol alphabet stops here
+  static constexpr int MAX_PHRASE_LENGTH = 255;
+
+  // keeps a shared model alive, meta refers to it
+  std::shared_ptr<const CodingMeta> shared_meta;
+  const CodingMeta &meta;
+  const int bits;
+  // parse tree: symbol count entries per inner node, each the next inner
+  // node or ~codeword for a phrase; the root is node 0
+  std::vector<int32_t> next_;
+  // the phrase of every codeword, back to back
+  std::string phrases_;
+  std::vector<uint32_t> offsets_;
+  // expected phrase length, the sum of the inner nodes' probabilities
+  double phrase_length_ = 0.;
+  // optional instrumentation, not to be shared between threads
+  Trace *trace = nullptr;
+
+  Tunstall(const CodingMeta &meta, int bits = DEFAULT_BITS):
+    meta(meta),
+    bits(bits)
+  {
+    if(bits < 1 || bits > MAX_BITS) {
+      throw std::runtime_error("codeword width out of range");
+    }
+    if(meta.size() == 0 || meta.size() > (size_t(1) << bits)) {
+      throw std::runtime_error("the alphabet does not fit the codewords");
+    }
+    build();
+  }
+
+  Tunstall(std::shared_ptr<const CodingMeta> meta, int bits = DEFAULT_BITS):
+    Tunstall(*meta, bits)
+  {
+    shared_meta = std::move(meta);
+  }
+
+  size_t size() const noexcept {
+    return offsets_.size() - 1;
+  }
+
+  void build() {
+    const size_t n = meta.size();
+    struct Leaf {
+      double p;
+      // entry of next_ the phrase hangs from
+      size_t slot;
+      int length;
+      bool operator<(const Leaf &other) const {
+        return p < other.p || (p == other.p && slot > other.slot);
+      }
+    };
+    std::priority_queue<Leaf> leaves;
+    // inner node of every entry's node, to spell the phrases
+    std::vector<size_t> parent_slot(1, size_t(-1));
+    next_.assign(n, 0);
+    for(size_t a = 0; a < n; ++a) {
+      leaves.push(Leaf{meta.get_prob(a), a, 1});
+    }
+    phrase_length_ = 1.;
+    size_t count = n;
+    while(count + n - 1 <= (size_t(1) << bits)) {
+      const auto leaf = leaves.top();
+      if(leaf.length >= MAX_PHRASE_LENGTH) {
+        break;
+      }
+      leaves.pop();
+      const int32_t node = parent_slot.size();
+      next_[leaf.slot] = node;
+      parent_slot.push_back(leaf.slot);
+      next_.resize(next_.size() + n, 0);
+      for(size_t a = 0; a < n; ++a) {
+        leaves.push(Leaf{leaf.p * meta.get_prob(a), node * n + a, leaf.length + 1});
+      }
+      phrase_length_ += leaf.p;
+      count += n - 1;
+    }
+    // codewords in tree order
+    std::vector<size_t> phrase_slots;
+    phrase_slots.reserve(leaves.size());
+    for(; !leaves.empty(); leaves.pop()) {
+      phrase_slots.push_back(leaves.top().slot);
+    }
+    std::sort(phrase_slots.begin(), phrase_slots.end());
+    phrases_.clear();
+    offsets_.assign(1, 0);
+    std::string phrase;
+    for(size_t i = 0; i < phrase_slots.size(); ++i) {
+      next_[phrase_slots[i]] = ~int32_t(i);
+      phrase.clear();
+      for(size_t slot = phrase_slots[i]; slot != size_t(-1); slot = parent_slot[slot / n]) {
+        phrase += meta.get_char(slot % n);
+      }
+      phrases_.append(phrase.rbegin(), phrase.rend());
+      offsets_.push_back(phrases_.length());
+    }
+  }
+
+  // bits of a message of n symbols at most, a codeword per symbol
+  size_t max_encoded_size(size_t n) const noexcept {
+    return n ? LENGTH_BITS + n * bits : 0;
+  }
+
+  DynamicBitset encode(const std::string &text) const {
+    DynamicBitset bset;
+    encode(text, bset);
+    return bset;
+  }
+
+  // into a reused buffer, returns the number of bits
+  size_t encode(const std::string &text, DynamicBitset &bset) const {
+    Trace::Timer timer(trace, "tunstall.encode");
+    bset.clear();
+    if(text.empty()) {
+      return 0;
+    }
+    auto put = [&](uint64_t x, int width) {
+      for(int i = width - 1; i >= 0; --i) {
+        bset.append_bit((x >> i) & 1);
+      }
+    };
+    put(text.length(), LENGTH_BITS);
+    const size_t n = meta.size();
+    uint64_t codewords = 0;
+    int32_t node = 0;
+    for(auto c : text) {
+      const auto a = meta.find_char(c);
+      if(a == CodingMeta::npos) {
+        throw std::domain_error("symbol outside of the alphabet");
+      }
+      node = next_[node * n + a];
+      if(node < 0) {
+        put(~node, bits);
+        ++codewords;
+        node = 0;
+      }
+    }
+    // pad the last phrase with the first symbol
+    if(node != 0) {
+      while(node >= 0) {
+        node = next_[node * n];
+      }
+      put(~node, bits);
+      ++codewords;
+    }
+    if(trace) {
+      trace->count("tunstall.codewords", codewords);
+    }
+    return bset.size();
+  }
+
+  // bits per symbol the model expects
+  double average_length() const {
+    return bits / phrase_length_;
+  }
+
+  std::string decode(const DynamicBitset &bset) const {
+    std::string s;
+    decode(bset, s);
+    return s;
+  }
+
+  // into a reused buffer, returns the number of symbols
+  size_t decode(const DynamicBitset &bset, std::string &s) const {
+    Trace::Timer timer(trace, "tunstall.decode");
+    s.clear();
+    if(bset.size() == 0) {
+      return 0;
+    }
+    if(bset.size() < LENGTH_BITS || (bset.size() - LENGTH_BITS) % bits) {
+      throw std::domain_error("truncated codeword");
+    }
+    const uint64_t length = bset.get_bits(0, LENGTH_BITS);
+    const size_t codewords = (bset.size() - LENGTH_BITS) / bits;
+    // a codeword holds one symbol at least, and no more than one is padding
+    if(codewords > length || length > codewords * MAX_PHRASE_LENGTH) {
+      throw std::domain_error("unable to fully decode the text");
+    }
+    s.reserve(length + MAX_PHRASE_LENGTH);
+    for(size_t pos = LENGTH_BITS; pos < bset.size(); pos += bits) {
+      const auto x = bset.get_bits(pos, bits);
+      if(x >= size()) {
+        throw std::domain_error("codeword outside of the dictionary");
+      }
+      s.append(phrases_, offsets_[x], offsets_[x + 1] - offsets_[x]);
+    }
+    if(s.length() < length) {
+      throw std::domain_error("unable to fully decode the text");
+    }
+    s.resize(length);
+    return s.length();
+  }
+};
+
+} // namespace coding
+
+#endif /* end of include guard: CODINGTUNSTALL_HPP */
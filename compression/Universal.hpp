@@ -0,0 +1,201 @@
+#ifndef CODINGUNIVERSAL_HPP
+#define CODINGUNIVERSAL_HPP
+
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include <BitIO.hpp>
+#include <DynamicBitset.hpp>
+
+namespace coding {
+
+// integer codes that need no model: small values take few bits and there
+// is no upper bound to agree on. they write to a DynamicBitset and read
+// from a BitReader, where a run of zeros is one count-leading-zeros.
+// a decoder checks after each value that the reader is still within its
+// stream, see PACK_PADDING.
+
+// elias gamma, x >= 1: the width of x less one in zeros, then x.
+// 2 floor(log2 x) + 1 bits
+struct EliasGamma {
+  static int size(uint64_t x) noexcept {
+    return 2 * (63 - clz64(x)) + 1;
+  }
+
+  static void encode(DynamicBitset &bset, uint64_t x) {
+    if(x == 0) {
+      throw std::domain_error("elias codes start from 1");
+    }
+    const int n = 63 - clz64(x);
+    put_bits(bset, 0, n);
+    put_bits(bset, x, n + 1);
+  }
+
+  static uint64_t decode(BitReader &r) {
+    const int n = r.leading_zeros();
+    if(n == 64) {
+      throw std::domain_error("invalid gamma code");
+    }
+    r.pos += n;
+    return r.read(n + 1);
+  }
+};
+
+// elias delta, x >= 1: the width of x in gamma, then x without its
+// leading one. shorter than gamma from x = 32 on
+struct EliasDelta {
+  static int size(uint64_t x) noexcept {
+    const int n = 63 - clz64(x);
+    return EliasGamma::size(n + 1) + n;
+  }
+
+  static void encode(DynamicBitset &bset, uint64_t x) {
+    if(x == 0) {
+      throw std::domain_error("elias codes start from 1");
+    }
+    const int n = 63 - clz64(x);
+    EliasGamma::encode(bset, n + 1);
+    put_bits(bset, x, n);
+  }
+
+  static uint64_t decode(BitReader &r) {
+    const uint64_t n = EliasGamma::decode(r) - 1;
+    if(n > 63) {
+      throw std::domain_error("invalid delta code");
+    }
+    return n == 0 ? 1 : (uint64_t(1) << n) | r.read(n);
+  }
+};
+
+// golomb-rice with parameter k, x >= 0: x >> k in zeros closed by a one,
+// then the low k bits. a quotient of ESCAPE or more is sent in delta
+// after ESCAPE zeros, so an outlier does not cost a run of zeros
+struct Rice {
+  static constexpr int ESCAPE = 32;
+
+  static int size(uint64_t x, int k) noexcept {
+    const uint64_t q = x >> k;
+    return (q < ESCAPE ? int(q) + 1 : ESCAPE + EliasDelta::size(q - ESCAPE + 1)) + k;
+  }
+
+  static void encode(DynamicBitset &bset, uint64_t x, int k) {
+    const uint64_t q = x >> k;
+    if(q < ESCAPE) {
+      put_bits(bset, 1, q + 1);
+    } else {
+      put_bits(bset, 0, ESCAPE);
+      EliasDelta::encode(bset, q - ESCAPE + 1);
+    }
+    put_bits(bset, x, k);
+  }
+
+  static uint64_t decode(BitReader &r, int k) {
+    const int n = r.leading_zeros();
+    uint64_t q;
+    if(n < ESCAPE) {
+      q = n;
+      r.pos += n + 1;
+    } else {
+      r.pos += ESCAPE;
+      q = EliasDelta::decode(r) + ESCAPE - 1;
+    }
+    return k ? (q << k) | r.read(k) : q;
+  }
+};
+
+// rice with the parameter fitted to the values so far, as in LOCO-I: the
+// smallest k with count << k >= sum. the sums are halved every RESET
+// values so the parameter follows a drifting source. encoder and decoder
+// update alike, nothing is sent
+struct AdaptiveRice {
+  static constexpr uint32_t RESET = 64;
+  // keeps count << k from overflowing
+  static constexpr uint64_t MAX_SUM = uint64_t(1) << 56;
+
+  uint64_t sum = 4;
+  uint32_t count = 1;
+
+  int parameter() const noexcept {
+    int k = 0;
+    while((uint64_t(count) << k) < sum) {
+      ++k;
+    }
+    return k;
+  }
+
+  void update(uint64_t x) noexcept {
+    const uint64_t limit = MAX_SUM;
+    sum = std::min(sum + std::min(x, limit), limit);
+    if(++count == RESET) {
+      sum >>= 1;
+      count >>= 1;
+    }
+  }
+
+  void encode(DynamicBitset &bset, uint64_t x) {
+    Rice::encode(bset, x, parameter());
+    update(x);
+  }
+
+  uint64_t decode(BitReader &r) {
+    const auto x = Rice::decode(r, parameter());
+    update(x);
+    return x;
+  }
+};
+
+// LEB128, x >= 0: seven bits at a time from the low end, each group in a
+// byte whose high bit says another follows. byte aligned, for offsets and
+// sizes in byte streams; in a bitset each byte is eight bits
+struct LEB128 {
+  static constexpr int MAX_BYTES = 10;
+
+  static int size(uint64_t x) noexcept {
+    return 8 * std::max(1, (64 - clz64(x) + 6) / 7);
+  }
+
+  static void encode(DynamicBitset &bset, uint64_t x) {
+    for(; x >= 0x80; x >>= 7) {
+      put_bits(bset, 0x80 | (x & 0x7f), 8);
+    }
+    put_bits(bset, x, 8);
+  }
+
+  static uint64_t decode(BitReader &r) {
+    uint64_t x = 0;
+    for(int i = 0; i < MAX_BYTES; ++i) {
+      const auto byte = r.read(8);
+      x |= (byte & 0x7f) << (7 * i);
+      if(!(byte & 0x80)) {
+        return x;
+      }
+    }
+    throw std::domain_error("invalid LEB128 code");
+  }
+
+  static void encode(std::string &bytes, uint64_t x) {
+    for(; x >= 0x80; x >>= 7) {
+      bytes += char(0x80 | (x & 0x7f));
+    }
+    bytes += char(x);
+  }
+
+  // reads at pos and moves it past the value
+  static uint64_t decode(const std::string &bytes, size_t &pos) {
+    uint64_t x = 0;
+    for(int i = 0; i < MAX_BYTES && pos < bytes.length(); ++i) {
+      const uint8_t byte = bytes[pos++];
+      x |= uint64_t(byte & 0x7f) << (7 * i);
+      if(!(byte & 0x80)) {
+        return x;
+      }
+    }
+    throw std::domain_error("invalid LEB128 code");
+  }
+};
+
+} // namespace coding
+
+#endif /* end of include guard: CODINGUNIVERSAL_HPP */
@@ -0,0 +1,171 @@
+#include "bitstreamview.h"
+
+#include <algorithm>
+
+#include <QFontMetrics>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QResizeEvent>
+#include <QScrollBar>
+
+SymbolLayout SymbolLayout::fixed(size_t width, size_t total_bits) {
+  SymbolLayout layout;
+  layout.stride = width;
+  layout.symbols = width ? (total_bits + width - 1) / width : 0;
+  return layout;
+}
+
+SymbolLayout SymbolLayout::variable(std::vector<uint8_t> lengths) {
+  SymbolLayout layout;
+  layout.symbols = lengths.size();
+  layout.checkpoints.reserve(lengths.size() / CHECKPOINT + 1);
+  size_t pos = 0;
+  for(size_t i = 0; i < lengths.size(); ++i) {
+    if(i % CHECKPOINT == 0) {
+      layout.checkpoints.push_back(pos);
+    }
+    pos += lengths[i];
+  }
+  layout.lengths = std::move(lengths);
+  layout.end = pos;
+  return layout;
+}
+
+void SymbolLayout::append(const uint8_t *more, size_t n) {
+  lengths.insert(lengths.end(), more, more + n);
+  for(size_t i = 0; i < n; ++i, ++symbols) {
+    if(symbols % CHECKPOINT == 0) {
+      checkpoints.push_back(end);
+    }
+    end += more[i];
+  }
+}
+
+size_t SymbolLayout::first_from(size_t bit, size_t &start) const {
+  size_t sym;
+  if(stride) {
+    sym = std::min(symbols, (bit + stride - 1) / stride);
+    start = sym * stride;
+    return sym;
+  }
+  // the last checkpoint before the bit, then symbol by symbol
+  const size_t k = std::lower_bound(checkpoints.begin(), checkpoints.end(), bit) - checkpoints.begin();
+  sym = k ? (k - 1) * CHECKPOINT : 0;
+  start = k ? checkpoints[k - 1] : 0;
+  while(sym < symbols && start < bit) {
+    start += lengths[sym++];
+  }
+  return sym;
+}
+
+BitstreamView::BitstreamView(QWidget *parent):
+    QAbstractScrollArea(parent)
+{
+  setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+  setVerticalScrollBarPolicy(Qt::ScrollBarAsNeeded);
+}
+
+void BitstreamView::set_bitstream(DynamicBitset bits, SymbolLayout layout) {
+  bits_ = std::move(bits);
+  layout_ = std::move(layout);
+  verticalScrollBar()->setValue(0);
+  update_scrollbar();
+  viewport()->update();
+}
+
+void BitstreamView::clear() {
+  set_bitstream(DynamicBitset());
+}
+
+void BitstreamView::set_hex(bool hex) {
+  if(hex_ == hex) {
+    return;
+  }
+  // keep the first visible bit in view
+  size_t first = size_t(verticalScrollBar()->value()) * chars_per_row() * bits_per_char();
+  hex_ = hex;
+  update_scrollbar();
+  verticalScrollBar()->setValue(first / bits_per_char() / chars_per_row());
+  viewport()->update();
+}
+
+int BitstreamView::bits_per_char() const {
+  return hex_ ? 4 : 1;
+}
+
+size_t BitstreamView::chars_total() const {
+  return (bits_.size() + bits_per_char() - 1) / bits_per_char();
+}
+
+// whole bytes per row
+int BitstreamView::chars_per_row() const {
+  const int group = CHAR_BIT / bits_per_char();
+  const int fit = viewport()->width() / std::max(1, fontMetrics().averageCharWidth());
+  return std::max(group, fit / group * group);
+}
+
+int BitstreamView::row_height() const {
+  return fontMetrics().height();
+}
+
+void BitstreamView::update_scrollbar() {
+  const size_t rows = (chars_total() + chars_per_row() - 1) / chars_per_row();
+  const int page = std::max(1, viewport()->height() / row_height());
+  verticalScrollBar()->setPageStep(page);
+  verticalScrollBar()->setSingleStep(1);
+  verticalScrollBar()->setRange(0, int(std::max<size_t>(rows, page) - page));
+}
+
+void BitstreamView::resizeEvent(QResizeEvent *event) {
+  QAbstractScrollArea::resizeEvent(event);
+  update_scrollbar();
+}
+
+void BitstreamView::paintEvent(QPaintEvent *event) {
+  QPainter painter(viewport());
+  painter.fillRect(event->rect(), palette().base());
+  painter.setPen(palette().text().color());
+
+  static const char *digits = "0123456789ABCDEF";
+  const QFontMetrics fm = fontMetrics();
+  const int cw = std::max(1, fm.averageCharWidth()), rh = row_height();
+  const int bpc = bits_per_char(), cpr = chars_per_row();
+  const size_t total = chars_total();
+  const QColor shade = palette().alternateBase().color();
+
+  const size_t first_row = verticalScrollBar()->value();
+  const int no_rows = viewport()->height() / rh + 1;
+  for(int r = 0; r < no_rows; ++r) {
+    const size_t first_char = (first_row + r) * cpr;
+    if(first_char >= total) {
+      break;
+    }
+    const int y = r * rh;
+    const size_t last_char = std::min<size_t>(total, first_char + cpr);
+    // the next symbol to start and where, walked along the row
+    size_t start = 0;
+    size_t sym = layout_.first_from(first_char * bpc, start);
+    QString row;
+    row.reserve(cpr);
+    for(size_t c = first_char; c < last_char; ++c) {
+      const size_t bit = c * bpc;
+      const int x = int(c - first_char) * cw;
+      if(!layout_.empty()) {
+        // symbols alternate between plain and shaded backgrounds,
+        // in hex a digit holding a symbol start is underlined
+        while(sym < layout_.symbols && start < bit) {
+          start += layout_.length(sym++);
+        }
+        const bool starts = sym < layout_.symbols && start < bit + bpc;
+        if(!hex_ && ((sym + starts) & 1)) {
+          painter.fillRect(x, y, cw, rh, shade);
+        }
+        if(hex_ && starts) {
+          painter.drawLine(x, y + rh - 1, x + cw - 1, y + rh - 1);
+        }
+      }
+      row += QLatin1Char(digits[bits_.get_bits(bit, bpc)]);
+    }
+    painter.drawText(0, y, cw * cpr, rh, Qt::AlignLeft | Qt::AlignTop, row);
+  }
+}
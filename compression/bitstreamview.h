@@ -0,0 +1,67 @@
+#ifndef BITSTREAMVIEW_H
+#define BITSTREAMVIEW_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <QAbstractScrollArea>
+
+#include <DynamicBitset.hpp>
+
+// where the codes of the symbols start in an encoded message, without a
+// word per symbol: fixed-width codes only have their width, prefix codes
+// the length of every code and the offset of every CHECKPOINT-th one, so
+// the symbols around a bit are found by a binary search and a short scan
+struct SymbolLayout {
+    static constexpr size_t CHECKPOINT = 256;
+
+    size_t symbols = 0;
+    size_t stride = 0;
+    std::vector<uint8_t> lengths;
+    std::vector<size_t> checkpoints;
+    // where the next variable length symbol would start
+    size_t end = 0;
+
+    static SymbolLayout fixed(size_t width, size_t total_bits);
+    static SymbolLayout variable(std::vector<uint8_t> lengths);
+    // variable length symbols after those there are
+    void append(const uint8_t *more, size_t n);
+
+    bool empty() const { return symbols == 0; }
+    size_t length(size_t sym) const { return stride ? stride : lengths[sym]; }
+    // the first symbol whose code starts at or after bit, and that start
+    size_t first_from(size_t bit, size_t &start) const;
+};
+
+// read-only view of an encoded message: only the rows that are scrolled into
+// view are rendered, straight from the packed bits, in binary or hex
+class BitstreamView : public QAbstractScrollArea {
+    Q_OBJECT
+
+    DynamicBitset bits_;
+    // where symbols start; may be empty
+    SymbolLayout layout_;
+    bool hex_ = false;
+
+public:
+    explicit BitstreamView(QWidget *parent = 0);
+
+    void set_bitstream(DynamicBitset bits, SymbolLayout layout = SymbolLayout());
+    void clear();
+    void set_hex(bool hex);
+    bool is_hex() const { return hex_; }
+
+protected:
+    void paintEvent(QPaintEvent *event);
+    void resizeEvent(QResizeEvent *event);
+
+private:
+    int bits_per_char() const;
+    size_t chars_total() const;
+    int chars_per_row() const;
+    int row_height() const;
+    void update_scrollbar();
+};
+
+#endif // BITSTREAMVIEW_H
@@ -0,0 +1,384 @@
+#include "encodingworker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <memory>
+
+#include <Coding.hpp>
+#include <Histogram.hpp>
+
+// the last input and its histogram, and the model it was coded with.
+// typing at the end of the input counts, encodes and decodes the new
+// symbols only, and the model stays until the user changes it: with
+// adjusted probabilities, the counts of the message it was fitted to
+struct EncodingWorker::Session {
+  std::string text;
+  coding::Histogram hist;
+
+  struct Model {
+    CodingMethod method;
+    std::string alphabet;
+    std::vector<float> probabilities;
+    // the probabilities were taken from the message
+    bool fitted;
+    coding::CodingMeta meta;
+    coding::Incremental<coding::Huffman> huffman;
+    coding::Incremental<coding::Arithmetic> arithmetic;
+    coding::Incremental<coding::LZ77> lz77;
+    coding::Incremental<coding::LZW> lzw;
+    // what the code up to decoded_bits decodes to, its symbols' layout
+    // and for LZW the phrases learned on the way
+    std::string decoded;
+    SymbolLayout layout;
+    coding::LZW::Decoder lzw_decoder;
+    size_t decoded_bits = 0;
+
+    Model(const EncodingJob &job, bool fitted):
+      method(job.method),
+      alphabet(job.alphabet),
+      probabilities(job.probabilities),
+      fitted(fitted),
+      meta(alphabet, probabilities),
+      huffman(meta),
+      arithmetic(meta),
+      lz77(meta),
+      lzw(meta)
+    {
+      lzw.coder.begin(lzw_decoder);
+    }
+
+    // a message with symbols the model can not code needs another one
+    bool serves(const EncodingJob &job, const coding::Histogram &hist) const {
+      if(job.remodel || method != job.method || alphabet != job.alphabet) {
+        return false;
+      }
+      if(job.adjust ? !fitted : probabilities != job.probabilities) {
+        return false;
+      }
+      for(size_t i = 0; i < alphabet.length(); ++i) {
+        if(probabilities[i] == 0. && hist.count(alphabet[i])) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    void restart() {
+      decoded.clear();
+      layout = SymbolLayout();
+      lzw.coder.begin(lzw_decoder);
+      decoded_bits = 0;
+    }
+
+    // encodes what the input adds to the coder's message into result and
+    // returns the bit decoding goes on from: the decoded part is dropped
+    // when the message started over or the coder wrote it again
+    template <typename CoderT>
+    size_t extend(coding::Incremental<CoderT> &coder, const std::string &input, EncodingResult &result, coding::Trace *trace) {
+      coding::attach_trace(coder, trace);
+      coding::Trace::Timer encode_timer(trace, "encode");
+      if(input.compare(0, coder.text().length(), coder.text()) != 0) {
+        coder.reset();
+      }
+      const size_t from = coder.append(input.substr(coder.text().length()));
+      result.encoded = coder.code();
+      result.encoded.append(coder.tail());
+      encode_timer.stop();
+      coding::attach_trace(coder, nullptr);
+      if(from < decoded_bits) {
+        restart();
+      }
+      return decoded_bits;
+    }
+  };
+  std::unique_ptr<Model> model;
+
+  // counts what the input adds to the last one, false if it is not an
+  // append and was counted over
+  bool count(const std::string &input) {
+    const bool extended = input.compare(0, text.length(), text) == 0;
+    if(!extended) {
+      text.clear();
+      hist = coding::Histogram();
+    }
+    hist.add(input.data() + text.length(), input.length() - text.length());
+    text.append(input, text.length(), std::string::npos);
+    return extended;
+  }
+};
+
+EncodingWorker::EncodingWorker(QObject *parent):
+    QObject(parent),
+    latest_(0)
+{
+  qRegisterMetaType<EncodingJob>("EncodingJob");
+  qRegisterMetaType<EncodingResult>("EncodingResult");
+}
+
+unsigned long long EncodingWorker::next_generation() {
+  return ++latest_;
+}
+
+EncodingWorker::~EncodingWorker() {}
+
+bool EncodingWorker::is_superseded(unsigned long long generation) const {
+  return generation != latest_.load();
+}
+
+template <typename CoderT>
+static std::string encode_decode(CoderT &coder, const std::string &input, EncodingResult &result, const EncodingWorker &worker, coding::Trace *trace) {
+  coding::attach_trace(coder, trace);
+  coding::Trace::Timer encode_timer(trace, "encode");
+  result.encoded = coder.encode(input);
+  encode_timer.stop();
+  // the encoded message is stale, no point decoding it
+  if(worker.is_superseded(result.generation)) {
+    coding::attach_trace(coder, nullptr);
+    return std::string();
+  }
+  coding::Trace::Timer decode_timer(trace, "decode");
+  auto decoded = coder.decode(result.encoded);
+  decode_timer.stop();
+  // the session keeps its coders beyond the job and its trace
+  coding::attach_trace(coder, nullptr);
+  return decoded;
+}
+
+// prefix codes: the length of every symbol's code, from the codec's table
+template <typename CoderT>
+static void code_lengths(const CoderT &coder, const coding::CodingMeta &meta, uint8_t (&code_length)[256]) {
+  std::fill(code_length, code_length + 256, 0);
+  for(size_t i = 0; i < meta.size(); ++i) {
+    code_length[uint8_t(meta.get_char(i))] = coder.code_length(i);
+  }
+}
+
+static std::vector<uint8_t> symbol_lengths(const uint8_t (&code_length)[256], const char *text, size_t n) {
+  std::vector<uint8_t> lengths;
+  lengths.reserve(n);
+  for(size_t i = 0; i < n; ++i) {
+    lengths.push_back(code_length[uint8_t(text[i])]);
+  }
+  return lengths;
+}
+
+template <typename CoderT>
+static SymbolLayout symbol_layout(const CoderT &coder, const coding::CodingMeta &meta, const std::string &input) {
+  uint8_t code_length[256];
+  code_lengths(coder, meta, code_length);
+  return SymbolLayout::variable(symbol_lengths(code_length, input.data(), input.length()));
+}
+
+// the same rules as the interface: the share of every symbol in the
+// message, the end of text once per message, adding up to 1
+static void histogram_probabilities(EncodingJob &job, const coding::Histogram &hist) {
+  const bool use_eot = job.method == CodingMethod::Arithmetic;
+  auto &probs = job.probabilities;
+  const size_t len = probs.size() - (use_eot ? 1 : 0);
+  const auto in_len = hist.size() + (use_eot ? 1 : 0);
+  for(size_t i = 0; i < len; ++i) {
+    probs[i] = float(hist.count(job.alphabet[i])) / in_len;
+  }
+  if(use_eot) {
+    auto p = 1. / in_len;
+    if(p < 1e-3) {
+      p = 2e-3;
+    }
+    probs.back() = p;
+  }
+  auto sum = .0f;
+  for(auto p : probs) {
+    sum += p;
+  }
+  if(!(std::fabs(1.f - sum) < 1e-6)) {
+    for(auto &p : probs) {
+      p /= sum;
+    }
+  }
+  if(use_eot && probs.back() < 3e-3) {
+    probs.back() = 3e-3;
+  }
+}
+
+void EncodingWorker::run(EncodingJob job) {
+  if(is_superseded(job.generation)) {
+    return;
+  }
+  EncodingResult result;
+  result.generation = job.generation;
+  try {
+    const auto input = job.input.toStdString();
+    result.input_length = input.length();
+    if(!session_) {
+      session_.reset(new Session());
+    }
+    const bool extended = session_->count(input);
+    const auto &hist = session_->hist;
+    auto &model = session_->model;
+    // fitted probabilities are kept while the message only grows
+    if(model && model->serves(job, hist) && (!job.adjust || extended)) {
+      job.probabilities = model->probabilities;
+    } else {
+      model.reset();
+      if(job.adjust && hist.size()) {
+        histogram_probabilities(job, hist);
+      }
+    }
+    result.probabilities = job.probabilities;
+
+    // remove symbols that can not be encoded, the interface sets the text
+    // and that is encoded in turn
+    std::vector<bool> allowed(256, false);
+    for(size_t i = 0; i < job.alphabet.length(); ++i) {
+      allowed[uint8_t(job.alphabet[i])] = job.probabilities[i] != 0.;
+    }
+    for(int i = 0; i < 256; ++i) {
+      if(hist.counts[i] && !allowed[i]) {
+        result.filtered = true;
+        break;
+      }
+    }
+    if(result.filtered) {
+      std::string s2;
+      s2.reserve(input.length());
+      for(auto c : input) {
+        if(allowed[uint8_t(c)]) {
+          s2 += c;
+        }
+      }
+      result.filtered_input = QString::fromStdString(s2);
+      emit finished(result);
+      return;
+    }
+
+    if(!model) {
+      model.reset(new Session::Model(job, job.adjust && hist.size()));
+    }
+    const auto &meta = model->meta;
+    std::unique_ptr<coding::Trace> trace;
+    if(job.trace) {
+      trace.reset(new coding::Trace());
+    }
+
+    // optimal performance and entropy
+    for(int i = 0; i < meta.size(); ++i) {
+      auto p = meta.get_prob(i);
+      result.entropy -= p * std::log2(p);
+    }
+    result.opt_perf = hist.ideal_length(meta);
+    if(job.method == CodingMethod::Arithmetic) {
+      auto p = meta.get_prob(meta.find_char(coding::Arithmetic::END_OF_TEXT));
+      result.opt_perf -= std::log2(p);
+      result.entropy -= p * std::log2(p);
+    }
+
+    std::string decoded;
+    if(input.length()) {
+      switch(job.method) {
+        case CodingMethod::NoCoding: {
+          coding::Base coder(meta);
+          decoded = encode_decode(coder, input, result, *this, trace.get());
+          result.avglen = coder.average_length();
+          result.layout = SymbolLayout::fixed(CHAR_BIT, result.encoded.size());
+        } break;
+        case CodingMethod::Block: {
+          coding::Block coder(meta);
+          decoded = encode_decode(coder, input, result, *this, trace.get());
+          result.avglen = coder.average_length();
+          result.layout = SymbolLayout::fixed(coder.block_size, result.encoded.size());
+        } break;
+        case CodingMethod::Huffman: {
+          auto &coder = model->huffman;
+          const size_t from = model->extend(coder, input, result, trace.get());
+          if(is_superseded(job.generation)) {
+            return;
+          }
+          coding::attach_trace(coder.coder, trace.get());
+          coding::Trace::Timer decode_timer(trace.get(), "decode");
+          const auto more = coder.coder.decode(coder.code().slice(from, coder.code().size() - from));
+          decode_timer.stop();
+          coding::attach_trace(coder.coder, nullptr);
+          uint8_t code_length[256];
+          code_lengths(coder.coder, meta, code_length);
+          const auto lengths = symbol_lengths(code_length, more.data(), more.length());
+          model->layout.append(lengths.data(), lengths.size());
+          model->decoded += more;
+          model->decoded_bits = coder.code().size();
+          decoded = model->decoded;
+          result.avglen = coder.coder.average_length();
+          result.layout = model->layout;
+        } break;
+        case CodingMethod::Arithmetic: {
+          // the interval's pending bits settle as the message grows, so
+          // its code is decoded in full. the end of text is appended by
+          // the coder
+          decoded = encode_decode(model->arithmetic, input, result, *this, trace.get());
+          decoded = decoded.substr(0, decoded.length() - 1);
+        } break;
+        case CodingMethod::Shannon: {
+          coding::Shannon coder(meta);
+          decoded = encode_decode(coder, input, result, *this, trace.get());
+          result.avglen = coder.average_length();
+          result.layout = symbol_layout(coder, meta, input);
+        } break;
+        case CodingMethod::LZ77: {
+          auto &coder = model->lz77;
+          const size_t from = model->extend(coder, input, result, trace.get());
+          if(is_superseded(job.generation)) {
+            return;
+          }
+          coding::attach_trace(coder.coder, trace.get());
+          coding::Trace::Timer decode_timer(trace.get(), "decode");
+          coder.coder.decode_more(coder.code(), from, coding::LZ77::Window{coder.coder.window_size, coder.coder.lookahead_size}, model->decoded);
+          decode_timer.stop();
+          coding::attach_trace(coder.coder, nullptr);
+          model->decoded_bits = coder.code().size();
+          decoded = model->decoded;
+        } break;
+        case CodingMethod::LZW: {
+          auto &coder = model->lzw;
+          const size_t from = model->extend(coder, input, result, trace.get());
+          if(is_superseded(job.generation)) {
+            return;
+          }
+          const int width = coder.coder.block_size;
+          coding::attach_trace(coder.coder, trace.get());
+          coding::Trace::Timer decode_timer(trace.get(), "decode");
+          coder.coder.decode_more(model->lzw_decoder, coder.code(), from, width, model->decoded);
+          model->decoded_bits = coder.code().size();
+          // the pending phrase is not learned, the next append extends it
+          decoded = model->decoded;
+          coder.coder.decode_tail(model->lzw_decoder, coder.tail(), width, decoded);
+          decode_timer.stop();
+          coding::attach_trace(coder.coder, nullptr);
+          result.layout = SymbolLayout::fixed(width, result.encoded.size());
+        } break;
+        case CodingMethod::Auto: {
+          coding::Auto coder(meta);
+          decoded = encode_decode(coder, input, result, *this, trace.get());
+          result.avglen = coder.average_length();
+        } break;
+      }
+    }
+    if(is_superseded(job.generation)) {
+      return;
+    }
+    result.decoded_length = decoded.length();
+    result.decoded = QString::fromStdString(decoded);
+    if(trace) {
+      result.trace_summary = QString::fromStdString(trace->summary());
+      result.trace_json = trace->to_chrome_trace();
+    }
+  } catch(std::exception &e) {
+    // the model's decoded part may be behind its code
+    if(session_) {
+      session_->model.reset();
+    }
+    result.error = QString::fromStdString(e.what());
+  }
+  if(is_superseded(job.generation)) {
+    return;
+  }
+  emit finished(result);
+}
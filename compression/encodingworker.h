@@ -0,0 +1,89 @@
+#ifndef ENCODINGWORKER_H
+#define ENCODINGWORKER_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <QObject>
+#include <QMetaType>
+#include <QString>
+
+#include <DynamicBitset.hpp>
+
+#include "bitstreamview.h"
+
+enum class CodingMethod {
+    NoCoding, Block, Huffman, Arithmetic, Shannon, LZ77, LZW, Auto
+};
+
+// everything the worker needs, copied out of the interface
+struct EncodingJob {
+    unsigned long long generation = 0;
+    CodingMethod method = CodingMethod::NoCoding;
+    // the end of text comes last for arithmetic coding
+    std::string alphabet;
+    std::vector<float> probabilities;
+    // take the probabilities from the message's histogram instead
+    bool adjust = false;
+    // the user changed the model, a fitted one is fitted again
+    bool remodel = false;
+    // converted and counted by the worker
+    QString input;
+    // collect codec counters and timings
+    bool trace = false;
+};
+
+struct EncodingResult {
+    unsigned long long generation = 0;
+    // the probabilities the message was encoded with, to show
+    std::vector<float> probabilities;
+    size_t input_length = 0;
+    // the message without the symbols it can not have, not yet encoded
+    bool filtered = false;
+    QString filtered_input;
+    DynamicBitset encoded;
+    // where the encoded symbols start, if the code has them
+    SymbolLayout layout;
+    QString decoded;
+    size_t decoded_length = 0;
+    double avglen = -1;
+    double entropy = 0.;
+    double opt_perf = 0.;
+    // filled for traced jobs: a readable digest and a chrome://tracing file
+    QString trace_summary;
+    std::string trace_json;
+    QString error;
+};
+
+Q_DECLARE_METATYPE(EncodingJob)
+Q_DECLARE_METATYPE(EncodingResult)
+
+// runs encode, decode and statistics off the UI thread; a job is dropped
+// at the next stage boundary as soon as a newer one has been requested
+class EncodingWorker : public QObject {
+    Q_OBJECT
+
+    std::atomic<unsigned long long> latest_;
+    // the last input and the model and coders of the last job, reused
+    // while the input only grows
+    struct Session;
+    std::unique_ptr<Session> session_;
+
+public:
+    explicit EncodingWorker(QObject *parent = 0);
+    ~EncodingWorker();
+
+    // thread-safe: supersedes every job issued before
+    unsigned long long next_generation();
+    bool is_superseded(unsigned long long generation) const;
+
+public slots:
+    void run(EncodingJob job);
+
+signals:
+    void finished(EncodingResult result);
+};
+
+#endif // ENCODINGWORKER_H
@@ -3,6 +3,9 @@
 
 #include <cmath>
 
+#include <QFile>
+#include <QFileDialog>
+
 #include <Coding.hpp>
 
 MainWindow::MainWindow(QWidget *parent):
@@ -10,6 +13,17 @@ MainWindow::MainWindow(QWidget *parent):
     ui(new Ui::MainWindow)
 {
   ui->setupUi(this);
+  // encoding runs on a worker thread, results come back as queued signals
+  worker_ = new EncodingWorker();
+  worker_->moveToThread(&worker_thread_);
+  connect(&worker_thread_, SIGNAL(finished()), worker_, SLOT(deleteLater()));
+  connect(this, SIGNAL(encoding_requested(EncodingJob)), worker_, SLOT(run(EncodingJob)), Qt::QueuedConnection);
+  connect(worker_, SIGNAL(finished(EncodingResult)), this, SLOT(show_encoding(EncodingResult)), Qt::QueuedConnection);
+  worker_thread_.start();
+  // typing into a large input only encodes once it pauses
+  debounce_timer_.setSingleShot(true);
+  connect(&debounce_timer_, SIGNAL(timeout()), this, SLOT(start_encoding()));
+
   ui->radioNoCoding->click();
   ui->doubleSpinBox_1->setVisible(false);
   ui->doubleSpinBox_2->setVisible(false);
@@ -20,9 +34,13 @@ MainWindow::MainWindow(QWidget *parent):
   ui->doubleSpinBox_7->setVisible(false);
   ui->doubleSpinBox_8->setVisible(false);
   ui->doubleSpinBox_EOT->setVisible(false);
+  ui->btnExportTrace->setEnabled(false);
 }
 
 MainWindow::~MainWindow() {
+  worker_->next_generation();
+  worker_thread_.quit();
+  worker_thread_.wait();
   delete ui;
 }
 
@@ -78,6 +96,7 @@ void MainWindow::on_btnGen_clicked() {
 }
 
 void MainWindow::on_textAlphabet_textChanged() {
+  remodel_ = true;
   auto s = ui->textAlphabet->toPlainText().toStdString();
   std::string s2;
   s2.reserve(s.length());
@@ -115,7 +134,8 @@ void MainWindow::on_textAlphabet_textChanged() {
   last_alphabet_length = s2.length();
 }
 
-// make sure probabilities add up to 1 and are non-negative
+// make sure probabilities add up to 1 and are non-negative; those from
+// the message's histogram come back with the encoding
 void MainWindow::adjust_probabilities() {
   auto &&alphabet_text = ui->textAlphabet->toPlainText().toStdString();
   auto len = alphabet_text.length();
@@ -139,36 +159,6 @@ void MainWindow::adjust_probabilities() {
   spinboxes.push_back(ui->doubleSpinBox_7);
   spinboxes.push_back(ui->doubleSpinBox_8);
 
-  if(ui->adjustCheckbox->isChecked()) {
-    const auto &&input_text = ui->textInput->toPlainText().toStdString();
-    if(input_text.length()) {
-      auto in_len = input_text.length();
-      int count[256];
-      for(int i = 0; i < 256; ++i) count[i] = 0;
-      for(auto &c : input_text) {
-        ++count[(unsigned char)(c)];
-      }
-      int start = 0;
-      if(ui->radioArith->isChecked()) {
-        start = 1;
-        ++in_len;
-        spinboxes[0]->setValue(1. / input_text.length() + 1);
-      }
-      for(int i = 0; i < len; ++i) {
-        unsigned char a = alphabet_text[i];
-        auto q = count[a];
-        spinboxes[start + i]->setValue(double(q) / in_len);
-      }
-      if(start == 1) {
-        auto p = 1. / in_len;
-        if(p < 1e-3) {
-            p = 2e-3;
-        }
-        spinboxes[0]->setValue(p);
-      }
-    }
-  }
-
   auto sum = .0f;
 
   auto use_eot = ui->radioArith->isChecked() ? 1 : 0;
@@ -204,12 +194,34 @@ void MainWindow::adjust_probabilities() {
 
 // adjust probabilities
 void MainWindow::on_btnAdjust_clicked() {
+  remodel_ = true;
   adjust_probabilities();
   update_input_text();
 }
 
-// input changed
+// input changed: supersede running jobs and restart the debounce timer
 void MainWindow::on_textInput_textChanged() {
+  worker_->next_generation();
+  auto size = ui->textInput->document()->characterCount();
+  debounce_timer_.start(size < DEBOUNCE_MIN_SIZE ? 0 : DEBOUNCE_MS);
+}
+
+CodingMethod MainWindow::coding_method() const {
+  if(ui->radioBlock->isChecked()) return CodingMethod::Block;
+  if(ui->radioHuffman->isChecked()) return CodingMethod::Huffman;
+  if(ui->radioArith->isChecked()) return CodingMethod::Arithmetic;
+  if(ui->radioShannon->isChecked()) return CodingMethod::Shannon;
+  if(ui->radioLZ77->isChecked()) return CodingMethod::LZ77;
+  if(ui->radioLZW->isChecked()) return CodingMethod::LZW;
+  if(ui->radioAuto->isChecked()) return CodingMethod::Auto;
+  return CodingMethod::NoCoding;
+}
+
+// gather the job from the interface and hand it to the worker, which
+// counts the message and takes the probabilities from it if asked to
+void MainWindow::start_encoding() {
+  EncodingJob job;
+  job.input = ui->textInput->toPlainText();
   adjust_probabilities();
   auto alphabet = ui->textAlphabet->toPlainText().toStdString();
   auto len = alphabet.length();
@@ -226,19 +238,6 @@ void MainWindow::on_textInput_textChanged() {
   if(len >= 7) probs.push_back(ui->doubleSpinBox_7->value());
   if(len >= 8) probs.push_back(ui->doubleSpinBox_8->value());
 
-  // remove duplicates
-  std::string s = ui->textInput->toPlainText().toStdString();
-  std::string s2;
-  for(auto c : s) {
-      if(alphabet.find(c) != std::string::npos && probs[alphabet.find(c)] != 0.) {
-          s2 += c;
-      }
-  }
-  if(s.length() != s2.length()) {
-      ui->textInput->document()->setPlainText(QString::fromStdString((s2)));
-      return;
-  }
-
   // set statistical tools visibility
   auto is_entr_coding = !(ui->radioLZ77->isChecked() || ui->radioLZW->isChecked());
   ui->actPerfText->setVisible(is_entr_coding);
@@ -267,84 +266,70 @@ void MainWindow::on_textInput_textChanged() {
     probs.push_back(ui->doubleSpinBox_EOT->value());
   }
 
-  // meta and source message
-  const auto &&meta = coding::CodingMeta(alphabet, probs);
-  const auto &&input = ui->textInput->toPlainText().toStdString();
+  ui->statusBar->showMessage("Encoding...");
 
-  ui->labelInput->setText((std::string("Input (") + std::to_string(input.length()) + std::string(")")).c_str());
+  job.method = coding_method();
+  job.alphabet = alphabet;
+  job.probabilities = probs;
+  job.adjust = ui->adjustCheckbox->isChecked();
+  job.remodel = remodel_;
+  job.trace = ui->traceCheckbox->isChecked();
+  job.generation = worker_->next_generation();
+  emit encoding_requested(job);
+}
 
-  // optimal performance and entropy
-  double opt_perf = 0.;
-  double entropy = 0.;
-  for(int i = 0; i < meta.size(); ++i) {
-    auto p = meta.get_prob(i);
-    entropy -= p * std::log2(p);
+// the probabilities a job was encoded with, end of text last
+void MainWindow::show_probabilities(const std::vector<float> &probs) {
+  QDoubleSpinBox *spinboxes[] = {
+    ui->doubleSpinBox_1, ui->doubleSpinBox_2, ui->doubleSpinBox_3, ui->doubleSpinBox_4,
+    ui->doubleSpinBox_5, ui->doubleSpinBox_6, ui->doubleSpinBox_7, ui->doubleSpinBox_8
+  };
+  auto len = probs.size();
+  if(ui->radioArith->isChecked() && len) {
+    ui->doubleSpinBox_EOT->setValue(probs[--len]);
   }
-  for(auto c : input) {
-    double p = meta.get_prob(meta.find_char(c));
-    opt_perf -= std::log2(p);
+  for(size_t i = 0; i < len && i < 8; ++i) {
+    spinboxes[i]->setValue(probs[i]);
   }
-  if(ui->radioArith->isChecked()) {
-    auto p = meta.get_prob(meta.find_char(coding::Arithmetic::END_OF_TEXT));
-    opt_perf -= std::log2(p);
-    entropy -= p * std::log2(p);
+}
+
+// results arrive through a queued connection from the worker thread
+void MainWindow::show_encoding(EncodingResult result) {
+  if(worker_->is_superseded(result.generation)) {
+    return;
   }
-  ui->entropyText->setText(std::to_string(entropy).c_str());
-  ui->optPerfText->setText(std::to_string(opt_perf).c_str());
-
-  DynamicBitset encoded;
-  double avglen = -1;
-  std::string decoded;
-  if(input.length()) {
-    if(ui->radioNoCoding->isChecked()) {
-      coding::Base coder(meta);
-      encoded = coder.encode(input);
-      avglen = coder.average_length();
-      decoded = coder.decode(encoded);
-    } else if(ui->radioBlock->isChecked()) {
-      coding::Block coder(meta);
-      encoded = coder.encode(input);
-      avglen = coder.average_length();
-      decoded = coder.decode(encoded);
-    } else if(ui->radioHuffman->isChecked()) {
-      coding::Huffman coder(meta);
-      encoded = coder.encode(input);
-      avglen = coder.average_length();
-      decoded = coder.decode(encoded);
-    } else if(ui->radioArith->isChecked()) {
-      coding::Arithmetic coder(meta);
-      std::string text = input + coding::Arithmetic::END_OF_TEXT;
-      encoded = coder.encode(text);
-      decoded = coder.decode(encoded);
-      decoded = decoded.substr(0, decoded.length() - 1);
-    } else if(ui->radioShannon->isChecked()) {
-      coding::Shannon coder(meta);
-      encoded = coder.encode(input);
-      avglen = coder.average_length();
-      decoded = coder.decode(encoded);
-    } else if(ui->radioLZ77->isChecked()) {
-      coding::LZ77 coder(meta);
-      encoded = coder.encode(input);
-      decoded = coder.decode(encoded);
-    } else if(ui->radioLZW->isChecked()) {
-      coding::LZW coder(meta);
-      encoded = coder.encode(input);
-      decoded = coder.decode(encoded);
-    }
+  if(!result.error.isEmpty()) {
+    ui->statusBar->showMessage(result.error);
+    return;
   }
-  if(avglen != -1 && !ui->radioArith->isChecked()) {
-    ui->avglenText->setText(std::to_string(avglen).c_str());
+  // the edited text is encoded as a new job
+  if(result.filtered) {
+    ui->textInput->document()->setPlainText(result.filtered_input);
+    return;
+  }
+  remodel_ = false;
+  ui->statusBar->clearMessage();
+  show_probabilities(result.probabilities);
+  ui->labelInput->setText((std::string("Input (") + std::to_string(result.input_length) + std::string(")")).c_str());
+
+  ui->entropyText->setText(std::to_string(result.entropy).c_str());
+  ui->optPerfText->setText(std::to_string(result.opt_perf).c_str());
+  if(result.avglen != -1 && !ui->radioArith->isChecked()) {
+    ui->avglenText->setText(std::to_string(result.avglen).c_str());
   }
 
-  ui->actPerfText->setText(std::to_string(double(encoded.size())).c_str());
+  const auto encoded_size = result.encoded.size();
+  ui->actPerfText->setText(std::to_string(double(encoded_size)).c_str());
 
-  ui->textOutput->setText(QString::fromStdString(encoded.str()));
-  ui->labelOutput->setText(QString::fromStdString(std::string() + "Encoded (" + std::to_string(encoded.size()) + ")"));
-  ui->labelDecoded->setText((std::string("Decoded (") + std::to_string(decoded.length()) + std::string(")")).c_str());
-  ui->textDecoded->setText(QString::fromStdString(decoded));
+  ui->textOutput->set_bitstream(std::move(result.encoded), std::move(result.layout));
+  ui->labelOutput->setText(QString::fromStdString(std::string() + "Encoded (" + std::to_string(encoded_size) + ")"));
+  ui->labelDecoded->setText((std::string("Decoded (") + std::to_string(result.decoded_length) + std::string(")")).c_str());
+  ui->textDecoded->setText(result.decoded);
+  ui->traceText->setPlainText(result.trace_summary);
+  last_trace_ = std::move(result.trace_json);
+  ui->btnExportTrace->setEnabled(!last_trace_.empty());
 }
 
-
 void MainWindow::on_radioNoCoding_clicked()
 {
   update_alphabet_text();
@@ -380,7 +365,37 @@ void MainWindow::on_radioLZW_clicked()
   update_alphabet_text();
 }
 
+void MainWindow::on_radioAuto_clicked()
+{
+  update_alphabet_text();
+}
+
 void MainWindow::on_adjustCheckbox_clicked()
 {
   update_alphabet_text();
 }
+
+void MainWindow::on_hexCheckbox_clicked()
+{
+  ui->textOutput->set_hex(ui->hexCheckbox->isChecked());
+}
+
+void MainWindow::on_traceCheckbox_clicked()
+{
+  update_alphabet_text();
+}
+
+// save the last trace for chrome://tracing or Perfetto
+void MainWindow::on_btnExportTrace_clicked()
+{
+  auto path = QFileDialog::getSaveFileName(this, "Export Trace", "trace.json", "Trace (*.json)");
+  if(path.isEmpty()) {
+    return;
+  }
+  QFile file(path);
+  if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    ui->statusBar->showMessage("Unable to write " + path);
+    return;
+  }
+  file.write(last_trace_.data(), last_trace_.size());
+}
@@ -0,0 +1,69 @@
+#ifndef MAINWINDOW_H
+#define MAINWINDOW_H
+
+#include <string>
+#include <vector>
+
+#include <QMainWindow>
+#include <QThread>
+#include <QTimer>
+
+#include "encodingworker.h"
+
+namespace Ui {
+class MainWindow;
+}
+
+class MainWindow : public QMainWindow {
+    Q_OBJECT
+
+    int last_alphabet_length = 0;
+    int current_alphabet_length = 0;
+
+    // inputs of at least this many characters are encoded after a pause
+    static constexpr int DEBOUNCE_MIN_SIZE = 1 << 16;
+    static constexpr int DEBOUNCE_MS = 250;
+    QTimer debounce_timer_;
+    QThread worker_thread_;
+    EncodingWorker *worker_ = nullptr;
+    // chrome://tracing file of the last traced encoding
+    std::string last_trace_;
+    // the model was changed since the last encoding shown
+    bool remodel_ = true;
+
+public:
+    explicit MainWindow(QWidget *parent = 0);
+    ~MainWindow();
+
+    void update_alphabet_text();
+    void update_input_text();
+    void adjust_probabilities();
+    void show_probabilities(const std::vector<float> &probs);
+    CodingMethod coding_method() const;
+signals:
+    void encoding_requested(EncodingJob job);
+private slots:
+    void start_encoding();
+    void show_encoding(EncodingResult result);
+    void on_btnGen_clicked();
+    void on_textAlphabet_textChanged();
+    void on_btnAdjust_clicked();
+    void on_textInput_textChanged();
+    void on_radioNoCoding_clicked();
+    void on_radioBlock_clicked();
+    void on_radioHuffman_clicked();
+    void on_radioArith_clicked();
+    void on_radioShannon_clicked();
+    void on_radioLZ77_clicked();
+    void on_radioLZW_clicked();
+    void on_radioAuto_clicked();
+    void on_adjustCheckbox_clicked();
+    void on_hexCheckbox_clicked();
+    void on_traceCheckbox_clicked();
+    void on_btnExportTrace_clicked();
+
+private:
+    Ui::MainWindow *ui;
+};
+
+#endif // MAINWINDOW_H
@@ -0,0 +1,705 @@
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <Coding.hpp>
+
+using namespace coding;
+
+void expect(bool ok, const std::string &what) {
+  if(!ok) {
+    throw std::logic_error(what);
+  }
+}
+
+template <typename F>
+void expect_throw(F &&f, const std::string &what) {
+  try {
+    f();
+  } catch(std::domain_error &) {
+    return;
+  }
+  throw std::logic_error(what + " was accepted");
+}
+
+// damage is reported, unless it hit a bit the coder does not read
+template <typename F>
+void expect_throw_or(F &&f, const std::string &text, const std::string &what) {
+  std::string s;
+  try {
+    s = f();
+  } catch(std::domain_error &) {
+    return;
+  }
+  expect(s == text, what + " gave a wrong text");
+}
+
+std::shared_ptr<const CodingMeta> make_meta(std::string alphabet, std::vector<float> probs) {
+  return std::make_shared<const CodingMeta>(alphabet, probs);
+}
+
+// random text of the alphabet, repeating itself in places so that the
+// dictionary coders find matches
+std::string genmsg(const std::string &alphabet, int n) {
+  std::string s;
+  while(int(s.length()) < n) {
+    if(s.length() > 16 && rand() % 4 == 0) {
+      auto from = rand() % (s.length() - 8);
+      s += s.substr(from, rand() % 64 + 1);
+    } else {
+      s += alphabet[rand() % (rand() % alphabet.length() + 1)];
+    }
+  }
+  s.resize(n);
+  return s;
+}
+
+// one-shot and buffer overloads agree and stay within max_encoded_size
+template <typename CoderT>
+void test_round_trip(CoderT &coder, const std::string &text, const std::string &name) {
+  auto enc = coder.encode(text);
+  expect(coder.decode(enc) == text, name + ": decoded text differs");
+  expect(enc.size() <= coder.max_encoded_size(text.length()), name + ": more bits than max_encoded_size");
+  DynamicBitset bset;
+  auto bits = coder.encode(text, bset);
+  expect(bits == bset.size() && bset.str() == enc.str(), name + ": buffer overload encodes differently");
+  std::string s = "stale";
+  auto len = coder.decode(bset, s);
+  expect(len == text.length() && s == text, name + ": buffer overload decodes differently");
+}
+
+template <typename CoderT>
+void test_coder(CoderT &&coder, const std::string &alphabet, const std::string &name) {
+  test_round_trip(coder, std::string(), name + " (empty)");
+  test_round_trip(coder, alphabet.substr(0, 1), name + " (one symbol)");
+  for(int n : {2, 100, 5000, 70000}) {
+    test_round_trip(coder, genmsg(alphabet, n), name);
+  }
+}
+
+// a frame checksum notices any flipped bit that matters and any cut
+template <typename CoderT>
+void test_corrupt(CoderT &&coder, const std::string &text, const std::string &name) {
+  const auto enc = coder.encode(text);
+  expect(coder.decode(enc) == text, name + ": decoded text differs");
+  for(int i = 0; i < 100; ++i) {
+    auto bad = enc;
+    auto ind = rand() % bad.size();
+    bad[ind] = !bad[ind];
+    expect_throw_or([&]() { return coder.decode(bad); }, text, name + ": flipped bit");
+  }
+  for(size_t cut = 1; cut <= 80 && cut <= enc.size(); ++cut) {
+    expect_throw([&]() { coder.decode(enc.slice(0, enc.size() - cut)); }, name + ": cut message");
+  }
+  expect_throw([&]() { coder.decode(DynamicBitset()); }, name + ": empty message");
+}
+
+// appending in pieces gives the code of one begin, encode_more, finish;
+// LZ77 parses every piece on its own, so its code only decodes the same
+template <typename CoderT>
+void test_streaming(CoderT &&oneshot, Incremental<CoderT> &&inc, const std::string &text, const std::string &name, bool same_code = true) {
+  DynamicBitset whole;
+  oneshot.begin();
+  oneshot.encode_more(text, whole);
+  oneshot.finish(whole);
+  DynamicBitset spliced, out;
+  for(size_t pos = 0; pos < text.length();) {
+    auto n = std::min<size_t>(rand() % 3000 + 1, text.length() - pos);
+    auto from = inc.append(text.substr(pos, n), out);
+    pos += n;
+    expect(from <= spliced.size(), name + ": bits handed out twice");
+    spliced = spliced.slice(0, from);
+    spliced.append(out);
+    expect(spliced.str() == inc.code().str(), name + ": new bits do not complete the code");
+  }
+  spliced.append(inc.tail());
+  expect(inc.encode(text).str() == spliced.str(), name + ": encode of the same text differs");
+  expect(inc.decode(spliced) == text, name + ": decoded text differs");
+  expect(!same_code || spliced.str() == whole.str(), name + ": appended code differs from one piece");
+}
+
+// the header carries all a fresh decoder needs, another message encoded
+// in between changes nothing
+template <typename CoderT>
+void test_bwt(std::shared_ptr<const CodingMeta> meta, const std::string &alphabet, const std::string &name) {
+  for(int n : {0, 1, 2, 100, 5000, 70000}) {
+    auto text = genmsg(alphabet, n);
+    BWT<CoderT> encoder(*meta, rand() % 1000 + 1);
+    auto enc = encoder.encode(text);
+    encoder.encode(genmsg(alphabet, 100));
+    BWT<CoderT> decoder(*meta);
+    expect(decoder.decode(enc) == text, name + ": decoded text differs");
+    if(n) {
+      expect_throw([&]() { decoder.decode(enc.slice(0, 40)); }, name + ": cut header");
+    }
+  }
+}
+
+// every message ends with the end of text, which the decoder stops at
+void test_arithmetic(std::shared_ptr<const CodingMeta> meta, const std::string &alphabet, const std::string &name) {
+  Arithmetic coder(meta);
+  const auto eot = Arithmetic::END_OF_TEXT;
+  test_round_trip(coder, std::string(1, eot), name + " (empty)");
+  for(int n : {1, 2, 100, 5000, 70000}) {
+    test_round_trip(coder, genmsg(alphabet, n) + eot, name);
+  }
+  auto text = genmsg(alphabet, 20000);
+  double entropy = 0.;
+  for(auto c : text) {
+    entropy -= std::log2(meta->get_prob(meta->find_char(c)));
+  }
+  expect(coder.encode(text + eot).size() < entropy + 64, name + ": longer than the model's entropy");
+  expect_throw([&]() { coder.encode(text + 'z' + eot); }, name + ": symbol outside of the alphabet");
+}
+
+using StaticCode = StaticHuffman<symbols<'a', 'b', 'c', 'd', 'e'>, frequencies<40, 30, 15, 10, 5>>;
+using LoneCode = StaticHuffman<symbols<'x'>, frequencies<1>>;
+
+// as short as a huffman code built at runtime for the same distribution
+void test_static_huffman() {
+  auto meta = make_meta("abcde", {.4f, .3f, .15f, .1f, .05f});
+  Huffman runtime(meta);
+  expect(std::fabs(StaticCode::average_length() - runtime.average_length()) < 1e-6, "static huffman: not optimal");
+  for(int n : {0, 1, 100, 5000}) {
+    auto text = genmsg("abcde", n);
+    auto enc = StaticCode::encode(text);
+    expect(StaticCode::decode(enc) == text, "static huffman: decoded text differs");
+    expect(enc.size() == runtime.encode(text).size(), "static huffman: longer than the runtime code");
+  }
+  expect_throw([]() { StaticCode::encode("abz"); }, "static huffman: symbol outside of the alphabet");
+  expect(LoneCode::decode(LoneCode::encode("xxx")) == "xxx", "static huffman (one symbol): decoded text differs");
+  // the one symbol's code leaves bit patterns that start no code
+  DynamicBitset bad;
+  bad.append_bit(1);
+  expect_throw([&]() { LoneCode::decode(bad); }, "static huffman (one symbol): unused pattern");
+}
+
+// the tables travel with the message, so any instance decodes it
+void test_context_huffman(std::shared_ptr<const CodingMeta> meta, const std::string &alphabet) {
+  for(int n : {0, 1, 100, 5000, 70000}) {
+    auto text = genmsg(alphabet, n);
+    ContextHuffman encoder(*meta), decoder(*meta);
+    auto enc = encoder.encode(text);
+    expect(decoder.decode(enc) == text, "context huffman: decoded text differs");
+    expect_throw([&]() { decoder.decode(enc.slice(0, meta->size())); }, "context huffman: cut tables");
+  }
+}
+
+// long enough for the tree to settle and the decoding table to be built,
+// and the same in pieces of a stream
+void test_adaptive_huffman(std::shared_ptr<const CodingMeta> meta, const std::string &alphabet) {
+  auto text = genmsg(alphabet, 20000) + std::string(5000, alphabet[0]);
+  AdaptiveHuffman encoder(*meta), decoder(*meta);
+  auto enc = encoder.encode(text);
+  expect(decoder.decode(enc) == text, "adaptive huffman: decoded text differs");
+  expect(decoder.table_rebuilds > 0, "adaptive huffman: the decoding table was never built");
+  expect(decoder.decode(DynamicBitset()).empty(), "adaptive huffman: empty message");
+  AdaptiveHuffman sender(*meta), receiver(*meta);
+  DynamicBitset stream;
+  std::string s;
+  size_t pos = 0;
+  for(size_t from = 0; from < text.length(); from += 1000) {
+    sender.encode_more(text.substr(from, 1000), stream);
+    receiver.decode_more(stream, pos, s);
+  }
+  expect(s == text && pos == stream.size(), "adaptive huffman: decoded stream differs");
+}
+
+void test_xxhash64() {
+  struct Vector {
+    std::string text;
+    uint64_t seed;
+    uint64_t hash;
+  };
+  const std::string fox = "The quick brown fox jumps over the lazy dog";
+  std::string bytes;
+  for(int i = 0; i < 100; ++i) {
+    bytes += char(i);
+  }
+  const Vector vectors[] = {
+    {"", 0, 0xEF46DB3751D8E999ull},
+    {"a", 0, 0xD24EC4F1A98C6E5Bull},
+    {"abc", 0, 0x44BC2CF5AD770999ull},
+    {"Nobody inspects the spammish repetition", 0, 0xFBCEA83C8A378BF1ull},
+    {fox, 0, 0x0B242D361FDA71BCull},
+    {fox, 1, 0xDF5091B6DAD2C6DBull},
+    {bytes, 0x9E3779B97F4A7C15ull, 0x3B97D91EBA03E785ull},
+  };
+  for(auto &v : vectors) {
+    expect(xxhash64(v.text, v.seed) == v.hash, "xxhash64 of \"" + v.text.substr(0, 16) + "\"");
+    // the same in pieces
+    XXHash64 h(v.seed);
+    for(size_t pos = 0; pos < v.text.length();) {
+      auto n = std::min<size_t>(rand() % 40, v.text.length() - pos);
+      h.update(v.text.data() + pos, n);
+      pos += n;
+    }
+    expect(h.digest() == v.hash, "xxhash64 in pieces of \"" + v.text.substr(0, 16) + "\"");
+  }
+}
+
+void test_universal_codes() {
+  std::vector<uint64_t> values = {1, 2, 3, 63, 64, 65, 1000, (uint64_t(1) << 32) - 1, uint64_t(1) << 63, ~uint64_t(0)};
+  for(int i = 0; i < 1000; ++i) {
+    values.push_back(uint64_t(rand()) % 100 + 1);
+  }
+  DynamicBitset bset;
+  AdaptiveRice rice_in;
+  for(auto x : values) {
+    EliasGamma::encode(bset, x);
+    EliasDelta::encode(bset, x);
+    Rice::encode(bset, x - 1, 3);
+    rice_in.encode(bset, x - 1);
+    LEB128::encode(bset, x - 1);
+  }
+  std::vector<uint64_t> words;
+  pack_bits(bset, 0, bset.size(), words);
+  BitReader r{words.data(), 0};
+  AdaptiveRice rice_out;
+  for(auto x : values) {
+    expect(EliasGamma::decode(r) == x, "elias gamma of " + std::to_string(x));
+    expect(EliasDelta::decode(r) == x, "elias delta of " + std::to_string(x));
+    expect(Rice::decode(r, 3) == x - 1, "rice of " + std::to_string(x));
+    expect(rice_out.decode(r) == x - 1, "adaptive rice of " + std::to_string(x));
+    expect(LEB128::decode(r) == x - 1, "leb128 of " + std::to_string(x));
+  }
+  expect(r.pos == bset.size(), "universal codes: bits left over");
+}
+
+// blocks of repeats, of noise and of symbols the model lacks each get
+// their own codec
+void test_auto(std::shared_ptr<const CodingMeta> meta, const std::string &alphabet) {
+  const size_t block = 4096;
+  std::string repeats;
+  auto phrase = genmsg(alphabet, 100);
+  while(repeats.length() < block) {
+    repeats += phrase;
+  }
+  repeats.resize(block);
+  std::string noise;
+  for(size_t i = 0; i < block; ++i) {
+    noise += alphabet[rand() % alphabet.length()];
+  }
+  std::string unknown = genmsg(alphabet, block);
+  unknown[rand() % block] = 'z';
+  auto text = repeats + noise + unknown + genmsg(alphabet, 1000);
+
+  Auto coder(*meta, block);
+  auto enc = coder.encode(text);
+  expect(Auto(*meta, block).decode(enc) == text, "auto: decoded text differs");
+  expect(coder.choices.size() == 4, "auto: wrong number of blocks");
+  expect(coder.choices[0] == Auto::Codec::LZ77 || coder.choices[0] == Auto::Codec::LZW, "auto: repeats not given to a dictionary coder");
+  expect(coder.choices[1] != Auto::Codec::LZ77 && coder.choices[1] != Auto::Codec::LZW, "auto: noise given to a dictionary coder");
+  expect(coder.choices[2] == Auto::Codec::Base, "auto: unknown symbol not given to the base coder");
+  expect(enc.size() < Base(*meta).encode(text).size(), "auto: longer than the base code");
+  expect(coder.encode("").size() == 0 && coder.decode(DynamicBitset()).empty(), "auto: empty message");
+
+  auto cut = enc.slice(0, enc.size() - 1);
+  expect_throw([&]() { Auto(*meta, block).decode(cut); }, "auto: truncated message");
+  auto bad = enc;
+  for(int i = 0; i < Auto::CODEC_BITS; ++i) {
+    bad[i] = 1;
+  }
+  expect_throw([&]() { Auto(*meta, block).decode(bad); }, "auto: unknown codec");
+}
+
+// repeats far beyond the LZ77 window go through the long matches
+void test_long_range(std::shared_ptr<const CodingMeta> meta, const std::string &alphabet) {
+  LongRangeLZ77 coder(*meta);
+  auto part = genmsg(alphabet, 50000);
+  auto text = part + genmsg(alphabet, 100000) + part.substr(100, 20000) + part;
+  auto enc = coder.encode(text);
+  expect(!coder.matches.empty(), "long range: no long matches");
+  expect(LongRangeLZ77(*meta).decode(enc) == text, "long range: decoded text differs");
+  expect(enc.size() < LZ77(meta).encode(text).size(), "long range: longer than lz77 alone");
+  for(int n : {0, 1, 100, 5000}) {
+    auto t = genmsg(alphabet, n);
+    expect(coder.decode(coder.encode(t)) == t, "long range: decoded text differs");
+  }
+  for(int cut = 1; cut <= 64; ++cut) {
+    auto bad = enc.slice(0, cut);
+    expect_throw([&]() { coder.decode(bad); }, "long range: truncated header");
+  }
+  // a match longer than the message
+  DynamicBitset bad;
+  for(uint64_t x : std::vector<uint64_t>{10, 1, 0, 1, uint64_t(1) << 40, 0}) {
+    LongRangeLZ77::put_number(bad, x);
+  }
+  expect_throw([&]() { coder.decode(bad); }, "long range: match past the end");
+}
+
+// any range decodes to the same symbols as the whole message
+template <typename CoderT>
+void test_seekable(std::shared_ptr<const CodingMeta> meta, const std::string &alphabet, const std::string &name) {
+  const size_t block = 1000;
+  Seekable<CoderT> encoder(*meta, block), decoder(*meta, block);
+  auto text = genmsg(alphabet, 10500);
+  auto enc = encoder.encode(text);
+  expect(Seekable<CoderT>::length(enc) == text.length(), name + ": wrong length");
+  expect(decoder.decode(enc) == text, name + ": decoded text differs");
+  for(int k = 0; k < 50; ++k) {
+    const size_t offset = rand() % (text.length() + 1), length = rand() % 3000;
+    expect(decoder.decode_range(enc, offset, length) == text.substr(offset, length), name + ": range differs");
+  }
+  expect(decoder.decode_range(enc, text.length(), 10).empty(), name + ": range at the end");
+  try {
+    decoder.decode_range(enc, text.length() + 1, 1);
+    expect(false, name + ": range past the end was accepted");
+  } catch(std::out_of_range &) {
+  }
+  expect(encoder.encode("").size() > 0 && decoder.decode(encoder.encode("")).empty(), name + ": empty message");
+  auto cut = enc.slice(0, enc.size() - 1);
+  expect_throw([&]() { decoder.decode_range(cut, text.length() - 1, 1); }, name + ": truncated last block");
+}
+
+// every occurrence, overlapping ones too
+std::vector<uint64_t> find_all(const std::string &text, const std::string &pattern) {
+  std::vector<uint64_t> found;
+  for(auto at = text.find(pattern); at != std::string::npos; at = text.find(pattern, at + 1)) {
+    found.push_back(at);
+  }
+  return found;
+}
+
+// searching the code finds what searching the text does
+void test_pattern_search(std::shared_ptr<const CodingMeta> meta, const std::string &alphabet) {
+  auto text = genmsg(alphabet, 20000);
+  LZ77 lz77(meta), lz77_universal(meta, nullptr, LZ77::Tokens::Universal);
+  LZW lzw(meta);
+  auto enc77 = lz77.encode(text), enc77u = lz77_universal.encode(text), encw = lzw.encode(text);
+  for(int k = 0; k < 20; ++k) {
+    // taken from the text, so that it occurs, or random, so that it may not
+    std::string pattern = k % 2 ? text.substr(rand() % (text.length() - 40), rand() % 40 + 1) : genmsg(alphabet, rand() % 4 + 1);
+    PatternSearch search(pattern);
+    auto expected = find_all(text, pattern);
+    expect(search.find(text) == expected, "pattern search: text");
+    expect(search.find(lz77, enc77) == expected, "pattern search: lz77");
+    expect(search.find(lz77_universal, enc77u) == expected, "pattern search: lz77 universal tokens");
+    expect(search.find(lzw, encw) == expected, "pattern search: lzw");
+  }
+  PatternSearch aaa("aaa");
+  expect(aaa.find(std::string(5, 'a')) == std::vector<uint64_t>({0, 1, 2}), "pattern search: overlaps");
+}
+
+// codecs loaded from a compiled model code like those built from the
+// probabilities, and the cache maps what an earlier cache wrote
+void test_model_cache(std::shared_ptr<const CodingMeta> meta, const std::string &alphabet) {
+  char dir[] = "/tmp/test_compressionXXXXXX";
+  expect(mkdtemp(dir) != nullptr, "model cache: no directory");
+  auto text = genmsg(alphabet, 5000);
+  {
+    ModelCache cache(dir);
+    auto model = cache.get(*meta);
+    expect(cache.get(*meta) == model, "model cache: compiled twice");
+    Huffman huffman(*meta, *model);
+    Shannon shannon(*meta, *model);
+    InterleavedHuffman interleaved(*meta, *model);
+    expect(huffman.encode(text).str() == Huffman(meta).encode(text).str(), "model cache: huffman codes differently");
+    expect(shannon.encode(text).str() == Shannon(meta).encode(text).str(), "model cache: shannon codes differently");
+    expect(interleaved.encode(text).str() == InterleavedHuffman(meta).encode(text).str(), "model cache: interleaved huffman codes differently");
+    test_round_trip(huffman, text, "huffman (compiled model)");
+    test_round_trip(interleaved, text, "interleaved huffman (compiled model)");
+    auto other = make_meta("ab", {.5f, .5f});
+    try {
+      Huffman wrong(*other, *model);
+      expect(false, "model cache: model of another alphabet was accepted");
+    } catch(std::runtime_error &) {
+    }
+  }
+  const auto file = ModelCache(dir).path(model_key(*meta));
+  auto mapped = ModelCache::map(file);
+  expect(mapped->matches(*meta), "model cache: wrong model written");
+  // a damaged file is compiled again
+  {
+    std::fstream f(file, std::ios::in | std::ios::out | std::ios::binary);
+    f.seekp(-1, std::ios::end);
+    f.put('\x5a');
+  }
+  try {
+    ModelCache::map(file);
+    expect(false, "model cache: damaged model was accepted");
+  } catch(std::runtime_error &) {
+  }
+  ModelCache cache(dir);
+  Huffman huffman(*meta, *cache.get(*meta));
+  test_round_trip(huffman, text, "huffman (recompiled model)");
+  ModelCache::map(file);
+  std::remove(file.c_str());
+  rmdir(dir);
+}
+
+// a codec given the only reference to its model keeps it alive
+template <typename CoderT>
+void test_shared_model(const std::string &alphabet, const std::string &name) {
+  CoderT coder(make_meta(alphabet, {.3f, .2f, .15f, .1f, .1f, .08f, .05f, .02f}));
+  // reuse the memory the model was in
+  auto other = make_meta("xy", {.5f, .5f});
+  auto text = genmsg(alphabet, 3000);
+  expect(coder.decode(coder.encode(text)) == text, name + ": decoded text differs");
+}
+
+// decoding leaves what the codec kept of the last encoded message alone
+void test_decode_state(std::shared_ptr<const CodingMeta> meta, const std::string &alphabet) {
+  ContextHuffman context(meta);
+  auto a = genmsg(alphabet, 5000), b = std::string(5000, alphabet[0]);
+  auto enc_b = context.encode(b);
+  context.encode(a);
+  const auto tables = context.tables.size();
+  expect(context.decode(enc_b) == b && context.tables.size() == tables, "context huffman: decode changed the tables");
+  LongRangeLZ77 long_range(meta);
+  auto part = genmsg(alphabet, 5000);
+  auto enc_a = long_range.encode(a);
+  long_range.encode(part + part);
+  const auto matches = long_range.matches.size();
+  expect(long_range.decode(enc_a) == a && long_range.matches.size() == matches, "long range: decode changed the matches");
+}
+
+// a few hundred symbols scattered over the whole range of a wide type
+template <typename Sym>
+std::vector<Sym> wide_message(size_t n) {
+  std::vector<Sym> symbols;
+  for(int i = 0; i < 300; ++i) {
+    symbols.push_back(Sym(uint64_t(rand()) * 2654435761u % (uint64_t(Sym(-1)) - 1)));
+  }
+  std::vector<Sym> text(n);
+  for(auto &c : text) {
+    c = symbols[rand() % (rand() % symbols.size() + 1)];
+  }
+  return text;
+}
+
+template <typename Sym>
+void test_wide_symbols(const std::string &name) {
+  auto text = wide_message<Sym>(20000);
+  auto meta = std::make_shared<const BasicCodingMeta<Sym>>(SparseHistogram<Sym>(text).meta());
+  BasicHuffman<Sym> huffman(meta);
+  BasicBlock<Sym> block(meta);
+  expect(huffman.decode(huffman.encode(text)) == text, name + " huffman: decoded text differs");
+  expect(block.decode(block.encode(text)) == text, name + " block: decoded text differs");
+  expect(huffman.encode(text).size() <= block.encode(text).size(), name + " huffman: longer than the block code");
+  auto missing = text;
+  missing.push_back(Sym(-2));
+  expect_throw([&]() { huffman.encode(missing); }, name + " huffman: symbol outside of the alphabet");
+  expect_throw([&]() { block.encode(missing); }, name + " block: symbol outside of the alphabet");
+}
+
+// many short messages built from the same phrases
+std::vector<std::string> similar_messages(const std::string &alphabet, int n) {
+  std::vector<std::string> phrases;
+  for(int i = 0; i < 16; ++i) {
+    phrases.push_back(genmsg(alphabet, 24));
+  }
+  std::vector<std::string> msgs(n);
+  for(auto &m : msgs) {
+    while(m.length() < 200) {
+      m += phrases[rand() % phrases.size()];
+      m += alphabet[rand() % alphabet.length()];
+    }
+  }
+  return msgs;
+}
+
+void test_dictionary(std::shared_ptr<const CodingMeta> meta, const std::string &alphabet) {
+  auto msgs = similar_messages(alphabet, 64);
+  auto trained = Dictionary::train(std::vector<std::string>(msgs.begin(), msgs.end() - 8), alphabet, 1024);
+  expect(trained.size() > 0 && trained.size() <= 1024, "dictionary: wrong size");
+  auto dict = std::make_shared<const Dictionary>(Dictionary::deserialize(trained.serialize()));
+  expect(dict->content() == trained.content() && dict->alphabet() == trained.alphabet(), "dictionary: serialized differently");
+  expect(dict->lzw_size() == trained.lzw_size(), "dictionary: primed differently");
+  try {
+    auto s = trained.serialize();
+    Dictionary::deserialize(s.substr(0, s.length() - 1));
+    expect(false, "dictionary: truncated dictionary was accepted");
+  } catch(std::runtime_error &) {
+  }
+
+  LZ77 lz77(meta, dict), lz77_universal(meta, dict, LZ77::Tokens::Universal), lz77_plain(meta);
+  LZW lzw(meta, dict), lzw_plain(meta);
+  size_t primed = 0, plain = 0;
+  // the held-out messages were not trained on
+  for(size_t i = msgs.size() - 8; i < msgs.size(); ++i) {
+    test_round_trip(lz77, msgs[i], "lz77 (dictionary)");
+    test_round_trip(lz77_universal, msgs[i], "lz77 universal tokens (dictionary)");
+    test_round_trip(lzw, msgs[i], "lzw (dictionary)");
+    primed += lz77.encode(msgs[i]).size() + lzw.encode(msgs[i]).size();
+    plain += lz77_plain.encode(msgs[i]).size() + lzw_plain.encode(msgs[i]).size();
+  }
+  expect(primed < plain, "dictionary: no gain on similar messages");
+  test_coder(LZ77(meta, dict), alphabet, "lz77 (dictionary)");
+  test_coder(LZW(meta, dict), alphabet, "lzw (dictionary)");
+}
+
+// the byte histogram splits long inputs between threads, the sparse one
+// must count the same
+void test_histograms() {
+  std::string text = genmsg("abcdefgh", (1 << 21) + 7);
+  text[0] = char(0xff);
+  Histogram serial, parallel(text, 4);
+  serial.add_serial(text.data(), text.length());
+  SparseHistogram<char> sparse(text);
+  expect(parallel.size() == text.length() && sparse.size() == text.length(), "histogram: wrong total");
+  for(int j = 0; j < 256; ++j) {
+    expect(parallel.count(char(j)) == serial.count(char(j)), "histogram: threads count differently");
+    expect(sparse.count(char(j)) == serial.count(char(j)), "sparse histogram: counts differently");
+  }
+  expect(std::fabs(sparse.entropy() - serial.entropy()) < 1e-9, "sparse histogram: wrong entropy");
+
+  std::vector<uint16_t> wide;
+  for(int i = 0; i < 10000; ++i) {
+    wide.push_back(uint16_t(60000 - (rand() % 7) * 1000));
+  }
+  SparseHistogram<uint16_t> h(wide);
+  auto a = h.alphabet();
+  expect(std::is_sorted(a.begin(), a.end()) && a.size() <= 7, "sparse histogram: wrong alphabet");
+  auto p = h.probabilities(a);
+  float sum = 0.f;
+  for(size_t i = 0; i < a.size(); ++i) {
+    expect(h.count(a[i]) == size_t(std::count(wide.begin(), wide.end(), a[i])), "sparse histogram: wrong count");
+    sum += p[i];
+  }
+  expect(std::fabs(sum - 1.f) < 1e-4, "sparse histogram: probabilities do not add up");
+  expect(h.count(1) == 0, "sparse histogram: counted a missing symbol");
+}
+
+#ifndef NO_TESTS
+#define NO_TESTS 10
+#endif /* ifndef NO_TESTS */
+int main() {
+  srand(time(NULL));
+  /* srand(0); */
+  const std::string alphabet = "abcdefgh";
+  auto meta = make_meta(alphabet, {.3f, .2f, .15f, .1f, .1f, .08f, .05f, .02f});
+  auto one = make_meta("a", {1.f});
+  auto skewed = make_meta("ab", {.99f, .01f});
+  // the arithmetic coder ends every message with an end of text
+  auto arith = make_meta(alphabet + Arithmetic::END_OF_TEXT, {.3f, .2f, .15f, .1f, .1f, .07f, .05f, .02f, .01f});
+
+  printf("xxhash64 test vectors\n");
+  test_xxhash64();
+  printf("universal codes\n");
+  test_universal_codes();
+  printf("histograms\n");
+  test_histograms();
+  for(int i = 0; i < NO_TESTS; ++i) {
+    printf("round trips: %d\n", i);
+    test_coder(Base(*meta), alphabet, "base");
+    test_coder(Block(meta), alphabet, "block");
+    test_coder(Huffman(meta), alphabet, "huffman");
+    test_coder(Shannon(meta), alphabet, "shannon");
+    test_coder(LZ77(meta), alphabet, "lz77");
+    test_coder(LZ77(meta, nullptr, LZ77::Tokens::Universal), alphabet, "lz77 universal tokens");
+    test_coder(LZW(meta), alphabet, "lzw");
+    test_coder(Tunstall(meta), alphabet, "tunstall");
+    test_coder(Tunstall(skewed, 4), "ab", "tunstall (skewed)");
+    test_coder(InterleavedHuffman(meta), alphabet, "interleaved huffman");
+    test_coder(InterleavedHuffman(meta, 1000), alphabet, "interleaved huffman (small blocks)");
+    test_coder(RunLength<>(skewed), "ab", "run length");
+
+    printf("per-block codec choice: %d\n", i);
+    test_auto(meta, alphabet);
+
+    printf("long range matches: %d\n", i);
+    test_long_range(meta, alphabet);
+
+    printf("seekable ranges: %d\n", i);
+    test_seekable<Base>(meta, alphabet, "seekable base");
+    test_seekable<Auto>(meta, alphabet, "seekable auto");
+
+    printf("pattern search: %d\n", i);
+    test_pattern_search(meta, alphabet);
+
+    printf("compiled models: %d\n", i);
+    test_model_cache(meta, alphabet);
+
+    printf("shared models: %d\n", i);
+    test_shared_model<AdaptiveHuffman>(alphabet, "adaptive huffman");
+    test_shared_model<Auto>(alphabet, "auto");
+    test_shared_model<BWT<Huffman>>(alphabet, "bwt huffman");
+    test_shared_model<ContextHuffman>(alphabet, "context huffman");
+    test_shared_model<LongRangeLZ77>(alphabet, "long range");
+    test_shared_model<RunLength<>>(alphabet, "run length");
+    test_shared_model<Seekable<Auto>>(alphabet, "seekable");
+    test_shared_model<InterleavedHuffman>(alphabet, "interleaved huffman");
+    test_shared_model<Tunstall>(alphabet, "tunstall");
+    test_decode_state(meta, alphabet);
+
+    printf("wide symbols: %d\n", i);
+    test_wide_symbols<uint16_t>("16-bit");
+    test_wide_symbols<uint32_t>("32-bit");
+
+    printf("preset dictionary: %d\n", i);
+    test_dictionary(meta, alphabet);
+
+    printf("arithmetic: %d\n", i);
+    test_arithmetic(arith, alphabet, "arithmetic");
+    test_arithmetic(make_meta(std::string("a") + Arithmetic::END_OF_TEXT, {.999f, .001f}), "a", "arithmetic (skewed)");
+
+    printf("block sorting: %d\n", i);
+    test_bwt<Huffman>(meta, alphabet, "bwt huffman");
+    test_bwt<Arithmetic>(meta, alphabet, "bwt arithmetic");
+    test_bwt<Huffman>(one, "a", "bwt huffman (one symbol)");
+
+    printf("static huffman: %d\n", i);
+    test_static_huffman();
+
+    printf("context huffman: %d\n", i);
+    test_context_huffman(meta, alphabet);
+    test_context_huffman(one, "a");
+
+    printf("adaptive huffman: %d\n", i);
+    test_adaptive_huffman(meta, alphabet);
+    test_adaptive_huffman(one, "a");
+
+    printf("one-symbol alphabet: %d\n", i);
+    test_coder(Huffman(one), "a", "huffman (one symbol)");
+    test_coder(LZ77(one), "a", "lz77 (one symbol)");
+    test_coder(LZW(one), "a", "lzw (one symbol)");
+    test_coder(Tunstall(one), "a", "tunstall (one symbol)");
+    test_coder(InterleavedHuffman(one), "a", "interleaved huffman (one symbol)");
+
+    printf("run length against its pipeline: %d\n", i);
+    for(int n : {0, 1, 1000, 100000}) {
+      auto text = genmsg("ab", n);
+      for(auto &c : text) {
+        c = rand() % 50 ? 'a' : 'b';
+      }
+      RunLength<> rl(skewed);
+      Pipeline<RunLengthStage, Huffman> pipe(skewed);
+      expect(rl.encode(text).str() == pipe.encode(text).str(), "run length and its pipeline encode differently");
+      expect(pipe.decode(pipe.encode(text)) == text, "pipeline: decoded text differs");
+      Pipeline<RunLengthStage, LZ77> pipe77(skewed);
+      expect(pipe77.decode(pipe77.encode(text)) == text, "pipeline (lz77): decoded text differs");
+      expect(rl.max_encoded_size(n) == pipe.max_encoded_size(n), "run length and its pipeline bound differently");
+    }
+
+    printf("corrupt input: %d\n", i);
+    auto text = genmsg(alphabet, 5000);
+    test_corrupt(Checked<Huffman>(meta), text, "checked huffman");
+    test_corrupt(Checked<LZ77>(meta), text, "checked lz77");
+    test_corrupt(Checked<LZW>(meta), text, "checked lzw");
+    test_corrupt(Checked<InterleavedHuffman>(meta), text, "checked interleaved huffman");
+    test_corrupt(Checked<Arithmetic>(arith), text + Arithmetic::END_OF_TEXT, "checked arithmetic");
+    // a token or code cut short is reported without the checksum too
+    {
+      LZ77 lz77(meta);
+      LZW lzw(meta);
+      auto enc77 = lz77.encode(text), encw = lzw.encode(text);
+      expect_throw([&]() { lz77.decode(enc77.slice(0, enc77.size() - 1)); }, "lz77: cut token");
+      expect_throw([&]() { lzw.decode(encw.slice(0, encw.size() - 1)); }, "lzw: cut code");
+    }
+
+    printf("streaming against one piece: %d\n", i);
+    text = genmsg(alphabet, 20000);
+    test_streaming(Huffman(meta), Incremental<Huffman>(meta), text, "huffman");
+    test_streaming(LZ77(meta), Incremental<LZ77>(meta), text, "lz77", false);
+    test_streaming(LZW(meta), Incremental<LZW>(meta), text, "lzw");
+    test_streaming(Checked<Huffman>(meta), Incremental<Checked<Huffman>>(meta), text, "checked huffman");
+  }
+}